@@ -24,7 +24,28 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#ifdef METADATA_ONLY
+#include <sys/mman.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef COPY_STATS
+#include <time.h>
+#endif
+#ifdef HEAP_PROFILE
+#include <execinfo.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#endif
 #include "./allocator_interface.h"
+#ifdef CACHESIM
+#include "./cachesim.h"
+#endif
+#include "./config.h"
 #include "./memlib.h"
 
 // Don't call libc malloc!
@@ -33,8 +54,14 @@
 #define realloc(...) (USE_MY_REALLOC)
 
 // All blocks must have a specified minimum alignment.
-// The alignment requirement (from config.h) is >= 8 bytes.
-#define ALIGNMENT 8
+// The alignment requirement (from config.h) is 8 bytes, or 16 with
+// make ALIGN16=1. In the 16-byte mode, blocks start 8 bytes before a 16-byte
+// boundary, so the 8-byte header still puts every payload on one, and block
+// sizes are multiples of 16; the header is no bigger.
+#define ALIGNMENT R_ALIGNMENT
+#if ALIGNMENT != 8 && ALIGNMENT != 16
+#error "R_ALIGNMENT must be 8 or 16"
+#endif
 
 // Rounds up to the nearest multiple of ALIGNMENT.
 #define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
@@ -63,13 +90,95 @@
 #define UNDER_BIT (0x2U)
 #define INFO_BITS (FREE_BIT)
 
+#ifndef MIN_BLOCK_POW
 #define MIN_BLOCK_POW 4
+#endif
+#ifndef MAX_BLOCK_POW
 #define MAX_BLOCK_POW 29
+#endif
 
 #define MIN_STORAGE (round_up(LINKS_SIZE))
+#ifndef SHRINK_MIN_SIZE
 #define SHRINK_MIN_SIZE 24
+#endif
 #define NUM_BINS (MAX_BLOCK_POW - MIN_BLOCK_POW)
 
+/* Sizes are 32 bits, so neighbours are not merged into a free block bigger
+ * than this. Blocks of 2^(MAX_BLOCK_POW - 1) bytes and up share the last
+ * bin. */
+#define MAX_BLOCK_SIZE ((uint32_t)-ALIGNMENT)
+
+/* Experimental locality-aware placement (make PARAMS="-D HOT_REGION=1").
+ * Blocks allocated close together in time tend to be used together, so a
+ * small request first looks for a free block within HOT_WINDOW bytes of the
+ * previous allocation (scanning at most HOT_SCAN blocks of its bin and the
+ * next), which keeps the live hot set on few cache lines and pages. */
+#ifndef HOT_REGION
+#define HOT_REGION 0
+#endif
+#ifndef HOT_MAX_SIZE
+#define HOT_MAX_SIZE 512
+#endif
+#ifndef HOT_WINDOW
+#define HOT_WINDOW 4096
+#endif
+#ifndef HOT_SCAN
+#define HOT_SCAN 16
+#endif
+
+/* Hugepage-aware placement (make PARAMS="-D HUGEPAGE_AWARE=1"). Reuse picks
+ * the lowest-addressed of the first HUGE_SCAN fitting blocks of a bin, so
+ * live data packs into the oldest, already used 2 MB regions and the ones
+ * near the brk drain. A block of at least HUGE_LARGE bytes that would span
+ * more hugepages than it needs starts on the next hugepage boundary instead;
+ * the gap becomes a free block for small requests. memlib advises the heap
+ * to be backed by transparent hugepages in this mode. */
+#ifndef HUGEPAGE_AWARE
+#define HUGEPAGE_AWARE 0
+#endif
+#ifndef HUGE_LARGE
+#define HUGE_LARGE (64 << 10)
+#endif
+#ifndef HUGE_SCAN
+#define HUGE_SCAN 8
+#endif
+#define HUGE_PAGE ((uintptr_t)2 << 20)
+
+/* my_realloc copies a moved block with non-temporal stores when it is at
+ * least STREAM_COPY_MIN bytes and 1/STREAM_COPY_CACHE_DIV of the last-level
+ * cache, so that growing a large buffer does not flush the rest of the
+ * working set out of the caches. The source is prefetched STREAM_PREFETCH
+ * bytes ahead. */
+#ifndef STREAM_COPY_MIN
+#define STREAM_COPY_MIN (256 << 10)
+#endif
+#ifndef STREAM_COPY_CACHE_DIV
+#define STREAM_COPY_CACHE_DIV 4
+#endif
+#define STREAM_PREFETCH 512
+#define DEFAULT_LLC_SIZE (8 << 20)
+#define huge_page(addr) ((uintptr_t)(addr) & ~(HUGE_PAGE - 1))
+
+/* Sampled heap profile (make HEAP_PROFILE=1). An allocation is sampled about
+ * every HEAP_SAMPLE_BYTES bytes allocated (exponentially distributed, so
+ * every byte is equally likely to be sampled), and its stack, up to
+ * HEAP_DEPTH frames, is its call site. Live and peak bytes are estimated per
+ * call site from the sampled blocks that are still live. At most
+ * HEAP_MAX_SITES call sites and HEAP_MAX_LIVE live samples are tracked;
+ * samples beyond that are dropped (and counted). */
+#ifndef HEAP_SAMPLE_BYTES
+#define HEAP_SAMPLE_BYTES (512 << 10)
+#endif
+#define HEAP_DEPTH 16
+#define HEAP_MAX_FRAME 100000
+#define HEAP_MAX_SITES 4096
+#define HEAP_MAX_LIVE (1 << 16)
+#define HEAP_FILTER 1024
+
+
+/* Offset of every block from an ALIGNMENT boundary: 0, or 8 in the 16-byte
+ * mode */
+#define BLOCK_OFFSET ((ALIGNMENT - HEADER_SIZE) & (ALIGNMENT - 1))
 
 /* Given a pointer, get the different perspectives corresponding to it */
 #define block(ptr) ((block_t*)((uint8_t*)ptr - HEADER_SIZE))
@@ -83,16 +192,16 @@
 
 /* Getters for a block_t. The *_free macros are used to determine whether
  * or not a block has been set free or not. */
-#define block_size(block) ((block)->size & ~INFO_BITS)
-#define block_prev_size(block) ((block)->prev_size & ~INFO_BITS)
-#define block_is_free(block) ((block)->size & FREE_BIT)
-#define prev_is_free(block) ((block)->prev_size & FREE_BIT)
+#define block_size(block) (meta(block)->size & ~INFO_BITS)
+#define block_prev_size(block) (meta(block)->prev_size & ~INFO_BITS)
+#define block_is_free(block) (meta(block)->size & FREE_BIT)
+#define prev_is_free(block) (meta(block)->prev_size & FREE_BIT)
 
 /* Setters for the fields of a block_t */
 #define set_freeness(block, free) \
-  (block->size = (((block)->size & ~FREE_BIT) | free))
+  (meta(block)->size = ((meta(block)->size & ~FREE_BIT) | free))
 #define mask_and_set_size(block, size) \
-  (block->size = (((block)->size & INFO_BITS) | (size & ~INFO_BITS)))
+  (meta(block)->size = ((meta(block)->size & INFO_BITS) | (size & ~INFO_BITS)))
 
 /* Finding a block_t's neighbors */
 #define right(block) \
@@ -125,6 +234,114 @@ typedef struct block_t {
 } block_t;
 
 
+////////////////////////////////////////////////////////////////////////////////
+// block metadata:
+
+#ifdef METADATA_ONLY
+/* Metadata-only simulation (make SIMULATE=1). Every block_t is kept in a side
+ * hash table keyed by the block's address instead of in the heap, so the
+ * allocator makes exactly the same placement decisions without ever touching
+ * heap memory. Only heap sizes are meaningful in this mode. */
+
+#define META_INIT_CAPACITY (1 << 12)
+#define META_SLACK 8
+
+typedef struct meta_entry_t {
+  uintptr_t key;  // block address, 0 if the entry is empty
+  block_t meta;
+} meta_entry_t;
+
+/* Open-addressed table with linear probing, sized to a power of two */
+static meta_entry_t* meta_table = NULL;
+static size_t meta_capacity = 0;
+static size_t meta_count = 0;
+
+INLINE static size_t meta_hash(uintptr_t key) {
+  return (size_t)(((key >> 3) * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/**
+ * Returns the metadata of the block at the given address, creating a zeroed
+ * entry if the block has none yet. Never resizes the table, so pointers
+ * returned earlier in the same operation stay valid (see meta_reserve).
+ */
+static block_t* meta_lookup(block_t* block) {
+  uintptr_t key = (uintptr_t)block;
+  size_t mask = meta_capacity - 1;
+  size_t i = meta_hash(key) & mask;
+
+  while (meta_table[i].key && meta_table[i].key != key) {
+    i = (i + 1) & mask;
+  }
+
+  if (!meta_table[i].key) {
+    assert(meta_count < meta_capacity);
+    meta_table[i].key = key;
+    memset(&meta_table[i].meta, 0, BLOCK_SIZE);
+    meta_count++;
+  }
+  return &meta_table[i].meta;
+}
+
+/**
+ * Make sure the table can take META_SLACK more blocks while staying at most
+ * half full. Called on entry to every allocator operation, since a single
+ * operation creates only a few new block boundaries.
+ */
+static void meta_reserve() {
+  if (2 * (meta_count + META_SLACK) <= meta_capacity) return;
+
+  meta_entry_t* old_table = meta_table;
+  size_t old_capacity = meta_capacity;
+
+  meta_capacity = old_capacity ? 2 * old_capacity : META_INIT_CAPACITY;
+  meta_table = mmap(NULL, meta_capacity * sizeof(meta_entry_t),
+                    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (meta_table == MAP_FAILED) {
+    fprintf(stderr, "ERROR: could not grow the metadata table\n");
+    exit(1);
+  }
+
+  // Rehash the old entries
+  size_t mask = meta_capacity - 1;
+  for (size_t j = 0; j < old_capacity; j++) {
+    if (!old_table[j].key) continue;
+    size_t i = meta_hash(old_table[j].key) & mask;
+    while (meta_table[i].key) {
+      i = (i + 1) & mask;
+    }
+    meta_table[i] = old_table[j];
+  }
+
+  if (old_table) {
+    munmap(old_table, old_capacity * sizeof(meta_entry_t));
+  }
+}
+
+/** Drop all metadata, for a fresh heap. */
+static void meta_reset() {
+  if (meta_table) {
+    munmap(meta_table, meta_capacity * sizeof(meta_entry_t));
+  }
+  meta_table = NULL;
+  meta_capacity = meta_count = 0;
+  meta_reserve();
+}
+
+#define meta(block) meta_lookup(block)
+#elif defined(CACHESIM)
+/* Cache simulation build (make CACHESIM=1): metadata stays in the heap, and
+ * every access to it is reported to the simulator (see mdriver -C). */
+#define meta(block) ((block_t*)cachesim_touch((block), sizeof(block_t)))
+#define meta_reserve()
+#define meta_reset()
+#else
+#define meta(block) (block)
+#define meta_reserve()
+#define meta_reset()
+#endif
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // static functions:
 
@@ -137,6 +354,9 @@ static uint32_t block_bin(uint32_t size);
 /* Operations on the free lists */
 static void push(block_t* block);
 static block_t* pull(uint32_t size, uint32_t bin);
+static block_t* pull_near(uint32_t size, uint32_t bin);
+static block_t* pull_low(uint32_t size, uint32_t bin);
+static void huge_pad(uint32_t size);
 static void extract(block_t* block_t);
 static void coalesce(block_t* block_t);
 static void shrink(block_t* block, uint32_t size);
@@ -156,6 +376,16 @@ uint8_t* heap_hi;
 /* prev_alloc is the first block_t before the brk pointer */
 block_t* prev_alloc;
 
+/* The most recently allocated block, the center of the hot region */
+uint8_t* hot_alloc;
+
+/* Moves of at least this many bytes are streamed (see STREAM_COPY_MIN) */
+size_t stream_threshold;
+
+#ifdef COPY_STATS
+copy_stats_t my_copy_stats;
+#endif
+
 /* Used to keep track of invariants */
 #ifdef DEBUG
 #define valid(header) __valid(header)
@@ -186,13 +416,13 @@ inline static void block_init(block_t* block, uint32_t size) {
   assert(size <= (heap_hi - heap_lo));
 
   // at init block is not free
-  block->size = size;
+  meta(block)->size = size;
 
   // check if there was a previously allocated block, and update its info
   if (prev_alloc == PREV_ALLOC_INIT) {
-    block->prev_size = 0;
+    meta(block)->prev_size = 0;
   } else {
-    block->prev_size = prev_alloc->size;
+    meta(block)->prev_size = meta(prev_alloc)->size;
   }
 }
 
@@ -205,7 +435,7 @@ INLINE static void block_set_free(block_t* block, uint8_t free) {
 
   // update in the next block, if it exists.
   if (under_hi(right(block))) {
-    right(block)->prev_size = block->size;
+    meta(right(block))->prev_size = meta(block)->size;
   }
 }
 
@@ -220,7 +450,7 @@ INLINE static void block_set_size(block_t* block, uint32_t size) {
 
   // update size in the next block, if it exists
   if (under_hi(right(block)))
-    right(block)->prev_size = block->size;
+    meta(right(block))->prev_size = meta(block)->size;
 }
 
 /** Check if block is the prev_alloc, and update the global variable if so. */
@@ -232,9 +462,11 @@ INLINE static void block_update_last(block_t* block) {
 
 /**
  * Given a size, returns the corresponsing bin to which the size belongs to.
+ * Sizes past the largest bin go to the last one.
  */
 inline static uint32_t block_bin(uint32_t size) {
-  return 32 - __builtin_clz((size) >> MIN_BLOCK_POW);
+  uint32_t bin = 32 - __builtin_clz((size) >> MIN_BLOCK_POW);
+  return bin < NUM_BINS ? bin : NUM_BINS - 1;
 }
 
 
@@ -246,13 +478,13 @@ INLINE static void push(block_t* block) {
   uint32_t bin = block_bin(block_size(block));
 
   block_set_free(block, FREE);
-  clear_block(block->prev);
+  clear_block(meta(block)->prev);
 
   if (bins[bin]) {
-    bins[bin]->prev = block;
+    meta(bins[bin])->prev = block;
   }
 
-  block->next = bins[bin];
+  meta(block)->next = bins[bin];
   bins[bin] = block;
 }
 
@@ -272,9 +504,9 @@ static block_t* pull(uint32_t size, uint32_t bin) {
 
   // Check first block
   if (block_size(curr) >= size) {
-    bins[bin] = curr->next;
+    bins[bin] = meta(curr)->next;
     if (bins[bin]) {
-      clear_block(bins[bin]->prev);
+      clear_block(meta(bins[bin])->prev);
     }
     block_set_free(curr, NOT_FREE);
     return curr;
@@ -282,11 +514,11 @@ static block_t* pull(uint32_t size, uint32_t bin) {
 
   // Check remaining blocks
   block_t* next;
-  while ((next = curr->next)) {
+  while ((next = meta(curr)->next)) {
     if (block_size(next) >= size) {
-        curr->next = next->next;
-      if (curr->next)
-        curr->next->prev = curr;
+      meta(curr)->next = meta(next)->next;
+      if (meta(curr)->next)
+        meta(meta(curr)->next)->prev = curr;
       block_set_free(next, NOT_FREE);
       return next;
     }
@@ -295,6 +527,49 @@ static block_t* pull(uint32_t size, uint32_t bin) {
   return NULL;
 }
 
+/**
+ * Remove a block of at least size bytes from the free list corresponding to
+ * bin, but only one within HOT_WINDOW bytes of the hot block, among the
+ * first HOT_SCAN blocks of the list. Returns NULL if there is none.
+ */
+static block_t* pull_near(uint32_t size, uint32_t bin) {
+  block_t* curr = bins[bin];
+
+  for (int i = 0; curr && i < HOT_SCAN; i++, curr = meta(curr)->next) {
+    uint8_t* addr = (uint8_t*)curr;
+    if (block_size(curr) >= size &&
+        addr + HOT_WINDOW > hot_alloc && addr < hot_alloc + HOT_WINDOW) {
+      extract(curr);
+      block_set_free(curr, NOT_FREE);
+      return curr;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Remove the lowest-addressed block of at least size bytes from the free
+ * list corresponding to bin, among the first HUGE_SCAN that fit. Returns NULL
+ * if no block fits.
+ */
+static block_t* pull_low(uint32_t size, uint32_t bin) {
+  block_t* best = NULL;
+  int fits = 0;
+
+  for (block_t* curr = bins[bin]; curr && fits < HUGE_SCAN;
+       curr = meta(curr)->next) {
+    if (block_size(curr) >= size) {
+      if (!best || curr < best) best = curr;
+      fits++;
+    }
+  }
+  if (best) {
+    extract(best);
+    block_set_free(best, NOT_FREE);
+  }
+  return best;
+}
+
 /**
  * Given a block, remove it from the free list that its in. The block must be in
  * the free list before calling this function.
@@ -304,17 +579,17 @@ static void extract(block_t* block) {
 
   uint32_t bin = block_bin(block_size(block));
 
-  if (block->prev) {
-    block->prev->next = block->next;
-    if (block->next) {
-      block->next->prev = block->prev;
+  if (meta(block)->prev) {
+    meta(meta(block)->prev)->next = meta(block)->next;
+    if (meta(block)->next) {
+      meta(meta(block)->next)->prev = meta(block)->prev;
     }
     return;
   }
 
-  bins[bin] = block->next;
-  if (block->next) {
-    clear_block(block->next->prev);
+  bins[bin] = meta(block)->next;
+  if (meta(block)->next) {
+    clear_block(meta(meta(block)->next)->prev);
   }
 }
 
@@ -328,7 +603,8 @@ static void coalesce(block_t* block) {
 
   // Try to merge right into block
   block_t* right = right(block);
-  if (under_hi(right) && block_is_free(right)) {
+  if (under_hi(right) && block_is_free(right) &&
+      (uint64_t)block_size(block) + block_size(right) <= MAX_BLOCK_SIZE) {
     // Remove from bin
     extract(right);
 
@@ -339,7 +615,8 @@ static void coalesce(block_t* block) {
 
   // Try to merge block into left
   block_t* left = left(block);
-  if (over_lo(left) && block_is_free(left)) {
+  if (over_lo(left) && block_is_free(left) &&
+      (uint64_t)block_size(left) + block_size(block) <= MAX_BLOCK_SIZE) {
     // Remove from bin
     extract(left);
 
@@ -380,6 +657,425 @@ static void shrink(block_t* block, uint32_t size) {
   }
 }
 
+/**
+ * Called before a block of size bytes is placed at the brk. If it would span
+ * more hugepages there than it needs, the space up to the next hugepage
+ * boundary is added to the heap as a free block first.
+ */
+static void huge_pad(uint32_t size) {
+  uintptr_t start = (uintptr_t)heap_hi;
+  uintptr_t needed = (size + HUGE_PAGE - 1) / HUGE_PAGE;
+  uintptr_t spanned = (huge_page(start + size - 1) - huge_page(start)) /
+                      HUGE_PAGE + 1;
+  uint32_t gap = huge_page(start + BLOCK_OFFSET + HUGE_PAGE - 1) -
+                 BLOCK_OFFSET - start;
+
+  if (spanned <= needed || gap < MIN_STORAGE) return;
+
+  block_t* block = mem_sbrk(gap);
+  if ((void*)block == (void*)-1) return;
+  heap_hi = (uint8_t*)block + gap;
+  block_init(block, gap);
+  prev_alloc = block;
+  coalesce(block);
+}
+
+#ifndef METADATA_ONLY
+/**
+ * Copy n bytes with non-temporal stores, 64 bytes at a time, prefetching the
+ * source ahead of the copy. The head and tail that don't fill an aligned
+ * 16-byte store go through memcpy.
+ */
+static void stream_copy(void* dst, const void* src, size_t n) {
+#ifdef __SSE2__
+  uint8_t* d = dst;
+  const uint8_t* s = src;
+  size_t head = -(uintptr_t)d & 15;
+
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  n -= head;
+  for (; n >= 64; n -= 64, d += 64, s += 64) {
+    _mm_prefetch((const char*)s + STREAM_PREFETCH, _MM_HINT_NTA);
+    __m128i a = _mm_loadu_si128((const __m128i*)s);
+    __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+    __m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+    _mm_stream_si128((__m128i*)d, a);
+    _mm_stream_si128((__m128i*)(d + 16), b);
+    _mm_stream_si128((__m128i*)(d + 32), c);
+    _mm_stream_si128((__m128i*)(d + 48), e);
+  }
+  _mm_sfence();
+  memcpy(d, s, n);
+#else
+  memcpy(dst, src, n);
+#endif
+}
+
+/**
+ * Copy the payload of a block that my_realloc moves, streaming large ones.
+ * With COPY_STATS, the copy is counted and timed in my_copy_stats.
+ */
+static void payload_copy(void* dst, const void* src, size_t n) {
+#ifdef COPY_STATS
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+
+  if (n >= stream_threshold) {
+    stream_copy(dst, src, n);
+  } else {
+    memcpy(dst, src, n);
+  }
+
+#ifdef COPY_STATS
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  my_copy_stats.moves++;
+  my_copy_stats.bytes += n;
+  if (n >= stream_threshold) {
+    my_copy_stats.streamed++;
+    my_copy_stats.streamed_bytes += n;
+  }
+  my_copy_stats.secs += (end.tv_sec - start.tv_sec) +
+                        (end.tv_nsec - start.tv_nsec) * 1e-9;
+#endif
+}
+#endif
+
+#ifdef HEAP_PROFILE
+////////////////////////////////////////////////////////////////////////////////
+// Sampled heap profile
+//
+// my_malloc and my_memalign count the bytes they hand out down from
+// heap_countdown; when it runs out, heap_sample records the block and its
+// stack, and draws the next countdown. my_free checks a small counting
+// filter of the live samples' addresses, and only looks the block up in
+// the (much larger) table of live samples if the filter has it. All the
+// state is static and nothing here calls malloc, so it also works inside
+// libmymalloc.so, under its lock.
+//
+// Each sample costs about half a microsecond. The traces allocate far
+// faster than real programs do (trace_c7 allocates 24 MB in ~100 us), so
+// at the default rate mdriver's throughput drops by ~12%, mostly on
+// trace_c2 and trace_c7; raise HEAP_PROFILE_RATE to trade detail for speed.
+//
+// Environment:
+//   HEAP_PROFILE_OUT     file the profile is written to at exit (default
+//                        heap_profile.<pid>)
+//   HEAP_PROFILE_RATE    mean bytes between samples (HEAP_SAMPLE_BYTES)
+//   HEAP_PROFILE_SIGNAL  signal number; on it, the profile is written to
+//                        <file>.<n> at the next sample, with bare addresses
+//                        and the mappings (see heap_dump)
+
+/* A call site: a distinct sampled stack */
+typedef struct {
+  int depth;
+  void* pcs[HEAP_DEPTH];
+  double live;        // estimated live bytes
+  double at_peak;     // estimated live bytes when the heap last peaked
+  double allocated;   // estimated bytes allocated in all
+  unsigned long samples;
+} heap_site_t;
+
+/* A sampled block that is still live */
+typedef struct {
+  void* ptr;          // NULL if the slot is empty
+  int site;
+  unsigned gen;       // the slot is empty unless this is heap_gen
+  double bytes;       // estimated bytes the sample stands for
+} heap_live_t;
+
+static heap_site_t heap_sites[HEAP_MAX_SITES];
+static int heap_num_sites;
+static int heap_site_slots[2 * HEAP_MAX_SITES];  // site + 1, or 0 if empty
+static heap_live_t heap_live[HEAP_MAX_LIVE];
+static unsigned heap_gen = 1;  // bumped by my_init, which empties heap_live
+static int heap_num_live;
+static uint16_t heap_filter[HEAP_FILTER];  // live samples per address hash
+static double heap_live_bytes, heap_peak_bytes;
+static unsigned long heap_dropped;
+
+static int64_t heap_countdown;
+static double heap_rate = HEAP_SAMPLE_BYTES;
+static uint64_t heap_rng = 88172645463325252ULL;
+static char heap_out[256];
+static int heap_started;
+static volatile sig_atomic_t heap_dump_requested;
+static int heap_dumps;
+
+static uint64_t heap_hash(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  return x ^ (x >> 33);
+}
+
+/* Bytes until the next sample: exponential with mean heap_rate */
+static int64_t heap_interval() {
+  heap_rng ^= heap_rng << 13;
+  heap_rng ^= heap_rng >> 7;
+  heap_rng ^= heap_rng << 17;
+  double u = ((heap_rng >> 11) + 1) * (1.0 / (1ULL << 53));  // in (0, 1]
+  return (int64_t)(-log(u) * heap_rate) + 1;
+}
+
+extern void* __libc_stack_end;
+
+/* Fill in site's stack, from the caller of the function this is inlined in,
+ * by following the frame pointers (HEAP_PROFILE builds keep them): a frame
+ * starts with its caller's frame pointer and its return address. The walk
+ * ends at a frame pointer that does not move up the stack by a sane amount,
+ * such as in code built without frame pointers. This is far cheaper than
+ * _Unwind_Backtrace, which looks up the unwind tables of every frame. */
+static inline __attribute__((always_inline)) void heap_backtrace(
+    heap_site_t* site) {
+  void** fp = __builtin_frame_address(0);
+  void** end = __libc_stack_end;
+  while (site->depth < HEAP_DEPTH && fp[1]) {
+    void** next = fp[0];
+    site->pcs[site->depth++] = fp[1];
+    if (next <= fp || (uintptr_t)next - (uintptr_t)fp > HEAP_MAX_FRAME ||
+        ((uintptr_t)next & (sizeof(void*) - 1)) ||
+        (fp < end && next + 2 > end)) {
+      break;
+    }
+    fp = next;
+  }
+}
+
+/* The index of the site with key's stack, added if new; -1 if full */
+static int heap_site(heap_site_t* key) {
+  uint64_t hash = key->depth;
+  for (int i = 0; i < key->depth; i++) {
+    hash = heap_hash(hash ^ (uintptr_t)key->pcs[i]);
+  }
+  for (int slot = hash & (2 * HEAP_MAX_SITES - 1);;
+       slot = (slot + 1) & (2 * HEAP_MAX_SITES - 1)) {
+    int s = heap_site_slots[slot] - 1;
+    if (s < 0) {
+      if (heap_num_sites == HEAP_MAX_SITES) return -1;
+      s = heap_num_sites++;
+      memcpy(&heap_sites[s], key, sizeof(heap_site_t));
+      heap_site_slots[slot] = s + 1;
+      return s;
+    }
+    if (heap_sites[s].depth == key->depth &&
+        !memcmp(heap_sites[s].pcs, key->pcs, key->depth * sizeof(void*))) {
+      return s;
+    }
+  }
+}
+
+#define heap_filter_slot(ptr) \
+  ((((uintptr_t)(ptr) * 0x9E3779B97F4A7C15ULL) >> 40) & (HEAP_FILTER - 1))
+
+#define heap_live_used(slot) \
+  (heap_live[slot].ptr && heap_live[slot].gen == heap_gen)
+
+/* The slot of ptr in heap_live, or the empty slot where it would go */
+static int heap_live_slot(void* ptr) {
+  int slot = heap_hash((uintptr_t)ptr) & (HEAP_MAX_LIVE - 1);
+  while (heap_live_used(slot) && heap_live[slot].ptr != ptr) {
+    slot = (slot + 1) & (HEAP_MAX_LIVE - 1);
+  }
+  return slot;
+}
+
+static void heap_dump_signal(int sig) {
+  heap_dump_requested = 1;
+}
+
+/* Called by my_init: the blocks of the previous heap are gone, so live and
+ * peak bytes start over (allocated bytes add up over all heaps). my_init is
+ * timed, so heap_live is emptied by moving to the next generation. */
+static void heap_profile_reset() {
+  heap_gen++;
+  memset(heap_filter, 0, sizeof(heap_filter));
+  heap_num_live = 0;
+  heap_live_bytes = heap_peak_bytes = 0;
+  for (int s = 0; s < heap_num_sites; s++) {
+    heap_sites[s].live = heap_sites[s].at_peak = 0;
+  }
+
+  if (!heap_started) {
+    const char* env;
+    heap_started = 1;
+    if ((env = getenv("HEAP_PROFILE_RATE")) && atof(env) > 0) {
+      heap_rate = atof(env);
+    }
+    if ((env = getenv("HEAP_PROFILE_OUT"))) {
+      snprintf(heap_out, sizeof(heap_out), "%s", env);
+    } else {
+      snprintf(heap_out, sizeof(heap_out), "heap_profile.%d", (int)getpid());
+    }
+    if ((env = getenv("HEAP_PROFILE_SIGNAL")) && atoi(env) > 0) {
+      struct sigaction sa;
+      memset(&sa, 0, sizeof(sa));
+      sa.sa_handler = heap_dump_signal;
+      sa.sa_flags = SA_RESTART;
+      sigemptyset(&sa.sa_mask);
+      sigaction(atoi(env), &sa, NULL);
+    }
+    heap_countdown = heap_interval();
+  }
+}
+
+/* Write formatted text to fd. dprintf may malloc its buffer, which under
+ * libmymalloc.so would come back here; vsnprintf does not, for these
+ * formats. */
+static void heap_printf(int fd, const char* format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (n >= (int)sizeof(line)) n = sizeof(line) - 1;
+  if (n > 0 && write(fd, line, n) < 0) return;
+}
+
+/**
+ * Write the call sites by estimated live bytes, with their bytes live when
+ * the heap peaked and allocated in all, and their stacks to path. With
+ * symbolize, stacks go through backtrace_symbols_fd (static functions show
+ * as offsets into the binary, for addr2line). It calls dladdr, which takes
+ * the dynamic loader's lock, and a thread in dlopen may hold that while it
+ * waits for our lock in malloc; so dumps taken inside the allocator write
+ * the bare addresses, followed by the process's mappings to resolve them
+ * with. Returns 0, or -1 if the file cannot be written.
+ */
+static int heap_dump(const char* path, int symbolize) {
+  static int order[HEAP_MAX_SITES];
+  int fd;
+
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) return -1;
+
+  // Insertion sort: qsort may call malloc
+  for (int i = 0; i < heap_num_sites; i++) {
+    int j = i;
+    for (; j > 0 && heap_sites[order[j - 1]].live < heap_sites[i].live; j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+
+  heap_printf(fd, "heap profile: 1 sample every %.0f bytes, %d call sites, "
+              "%lu samples dropped\n", heap_rate, heap_num_sites,
+              heap_dropped);
+  heap_printf(fd, "live %.0f bytes, peak %.0f bytes (estimated)\n",
+              heap_live_bytes, heap_peak_bytes);
+  for (int i = 0; i < heap_num_sites; i++) {
+    heap_site_t* site = &heap_sites[order[i]];
+    heap_printf(fd, "\n%.0f live, %.0f at peak, %.0f allocated, "
+                "%lu samples\n", site->live, site->at_peak, site->allocated,
+                site->samples);
+    if (symbolize) {
+      backtrace_symbols_fd(site->pcs, site->depth, fd);
+    } else {
+      for (int d = 0; d < site->depth; d++) {
+        heap_printf(fd, "[%p]\n", site->pcs[d]);
+      }
+    }
+  }
+
+  if (!symbolize) {
+    char buf[4096];
+    ssize_t n;
+    int maps = open("/proc/self/maps", O_RDONLY);
+    heap_printf(fd, "\nmappings:\n");
+    while (maps >= 0 && (n = read(maps, buf, sizeof(buf))) > 0) {
+      if (write(fd, buf, n) < 0) break;
+    }
+    if (maps >= 0) close(maps);
+  }
+  return close(fd);
+}
+
+/* Record the block at ptr, of size bytes, as a sample */
+static __attribute__((noinline)) void heap_sample(void* ptr, size_t size) {
+  heap_site_t key;
+  int site;
+
+  heap_countdown = heap_interval();
+  if (heap_dump_requested) {
+    char path[sizeof(heap_out) + 16];
+    heap_dump_requested = 0;
+    snprintf(path, sizeof(path), "%s.%d", heap_out, ++heap_dumps);
+    heap_dump(path, 0);
+  }
+
+  // The stack, from this function's caller
+  memset(&key, 0, sizeof(key));
+  heap_backtrace(&key);
+  if ((site = heap_site(&key)) < 0 || heap_num_live >= HEAP_MAX_LIVE / 2) {
+    heap_dropped++;
+    return;
+  }
+
+  // A block of size bytes is sampled with probability 1 - exp(-size/rate)
+  double bytes = size ? size / -expm1(-(double)size / heap_rate) : heap_rate;
+  int slot = heap_live_slot(ptr);
+  if (!heap_live_used(slot)) {
+    heap_num_live++;
+    heap_filter[heap_filter_slot(ptr)]++;
+  }
+  heap_live[slot].ptr = ptr;
+  heap_live[slot].site = site;
+  heap_live[slot].gen = heap_gen;
+  heap_live[slot].bytes = bytes;
+
+  heap_sites[site].live += bytes;
+  heap_sites[site].allocated += bytes;
+  heap_sites[site].samples++;
+  heap_live_bytes += bytes;
+  if (heap_live_bytes > heap_peak_bytes) {
+    heap_peak_bytes = heap_live_bytes;
+    for (int s = 0; s < heap_num_sites; s++) {
+      heap_sites[s].at_peak = heap_sites[s].live;
+    }
+  }
+}
+
+/* If the block at ptr was sampled, it is no longer live */
+static void heap_unsample(void* ptr) {
+  int slot = heap_live_slot(ptr);
+  if (!heap_live_used(slot)) return;
+
+  heap_sites[heap_live[slot].site].live -= heap_live[slot].bytes;
+  heap_live_bytes -= heap_live[slot].bytes;
+  heap_num_live--;
+  heap_filter[heap_filter_slot(ptr)]--;
+
+  // Delete by shifting back the entries that probed past the slot
+  for (int next = (slot + 1) & (HEAP_MAX_LIVE - 1); heap_live_used(next);
+       next = (next + 1) & (HEAP_MAX_LIVE - 1)) {
+    int home = heap_hash((uintptr_t)heap_live[next].ptr) & (HEAP_MAX_LIVE - 1);
+    if (((next - home) & (HEAP_MAX_LIVE - 1)) >=
+        ((next - slot) & (HEAP_MAX_LIVE - 1))) {
+      heap_live[slot] = heap_live[next];
+      slot = next;
+    }
+  }
+  heap_live[slot].ptr = NULL;
+}
+
+#define heap_account(ptr, size) \
+  if ((ptr) && (heap_countdown -= (size)) < 0) heap_sample((ptr), (size))
+
+/**
+ * heap_profile_dump - Write the profile to path, symbolized (see heap_dump),
+ * so not from inside the allocator. NULL writes to the file the exit dump
+ * goes to.
+ */
+int my_heap_profile_dump(const char* path) {
+  return heap_dump(path ? path : heap_out, 1);
+}
+
+static __attribute__((destructor)) void heap_profile_exit() {
+  if (heap_num_sites) my_heap_profile_dump(NULL);
+}
+#endif
+
 int my_check() {
   return 0;
 }
@@ -392,49 +1088,92 @@ int my_check() {
 int my_init() {
   // Empty bins, initialize globals
   memset(bins, 0, NUM_BINS * sizeof(block_t*));
+  meta_reset();
+#ifdef HEAP_PROFILE
+  heap_profile_reset();
+#endif
 
-  // Align brk with the cache line
+  // Align brk with the cache line (in the 16-byte mode, the first block's
+  // header ends on it, and its payload starts on it)
   void* brk = mem_heap_hi() + 1;
-  uint64_t size = CACHE_ALIGN((uint64_t)brk) - (uint64_t)brk;
+  uint64_t size = CACHE_ALIGN((uint64_t)brk + BLOCK_OFFSET) - BLOCK_OFFSET -
+                  (uint64_t)brk;
 
   // set the initial boundaries of the heap
-  heap_lo = heap_hi = (uint8_t*)mem_sbrk(size) + size;
+  brk = mem_sbrk(size);
+  if (brk == (void*)-1) return -1;
+  heap_lo = heap_hi = (uint8_t*)brk + size;
   prev_alloc = PREV_ALLOC_INIT;
+  hot_alloc = heap_lo;
+
+  // Size the streaming copies by the last-level cache, once
+  if (!stream_threshold) {
+    long llc = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llc <= 0) llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    if (llc <= 0) llc = DEFAULT_LLC_SIZE;
+    stream_threshold = llc / STREAM_COPY_CACHE_DIV;
+    if (stream_threshold < STREAM_COPY_MIN) stream_threshold = STREAM_COPY_MIN;
+  }
   return 0;
 }
 
 /**
- * malloc - Allocate a block by incrementing the brk pointer.
+ * allocate - Allocate a block by incrementing the brk pointer.
  * Always allocate a block whose size is a multiple of the alignment.
  */
-void* my_malloc(size_t size) {
+static INLINE void* allocate(size_t size) {
   block_t* block;
+  meta_reserve();
 
   // make sure we have space to store
   size = size_fits(size) ?  MIN_STORAGE : round_up(size);
 
   if (heap_hi != heap_lo) {
+    // Try to reuse freed blocks near the last allocation
+    if (HOT_REGION && size <= HOT_MAX_SIZE) {
+      for (int bin = block_bin(size);
+           bin < NUM_BINS && bin < block_bin(size) + 2; bin++) {
+        block = pull_near(size, bin);
+        if (block) {
+          shrink(block, size);
+          hot_alloc = (uint8_t*)block;
+          return data(block);
+        }
+      }
+    }
+
     // Try to reuse freed blocks
     for (int bin = block_bin(size); bin < NUM_BINS; bin++) {
-      block = pull(size, bin);
+      block = HUGEPAGE_AWARE ? pull_low(size, bin) : pull(size, bin);
       if (block) {
         shrink(block, size);
+        hot_alloc = (uint8_t*)block;
         return data(block);
       }
     }
 
-    if (block_is_free(prev_alloc)) {
-      extract(prev_alloc);
+    if (block_is_free(prev_alloc) &&
+        !(HUGEPAGE_AWARE && size >= HUGE_LARGE)) {
       size_t diff = ALIGN(size - block_size(prev_alloc));
-      heap_hi = (uint8_t*)mem_sbrk(diff) + diff;
+
+      // Return NULL on failure, leaving prev_alloc in its bin
+      if (mem_sbrk(diff) == (void*)-1) return NULL;
+      extract(prev_alloc);
+      heap_hi += diff;
 
       // automatically sets the FREE_BIT to zero
-      prev_alloc->size = block_size(prev_alloc) + diff;
+      meta(prev_alloc)->size = block_size(prev_alloc) + diff;
+      hot_alloc = (uint8_t*)prev_alloc;
       return data(prev_alloc);
     }
   }
 
 
+  if (HUGEPAGE_AWARE && size >= HUGE_LARGE) huge_pad(size);
+
   // Expand heap by block size
   block = mem_sbrk(size);
 
@@ -447,19 +1186,54 @@ void* my_malloc(size_t size) {
   block_init(block, size);
 
   prev_alloc = block;
+  hot_alloc = (uint8_t*)block;
   return data(block);
 }
 
+/** malloc - allocate, and count the bytes towards the next heap sample */
+void* my_malloc(size_t size) {
+  void* ptr = allocate(size);
+#ifdef HEAP_PROFILE
+  heap_account(ptr, size);
+#endif
+  return ptr;
+}
+
 /**
  * Add the block to its appropriate free list and coalesce if possible.
  */
 void my_free(void* ptr) {
   if (!ptr) return;
+  meta_reserve();
+#ifdef HEAP_PROFILE
+  if (heap_filter[heap_filter_slot(ptr)]) heap_unsample(ptr);
+#endif
 
   // Try to coalesce block with freed neighbors
   coalesce(block(ptr));
 }
 
+/**
+ * calloc - malloc, then zero the payload (the heap is reused between runs,
+ * so fresh memory from the brk is not known to be zero).
+ */
+void* my_calloc(size_t nmemb, size_t size) {
+  size_t total = nmemb * size;
+  if (size && total / size != nmemb) return NULL;
+
+  void* ptr = my_malloc(total);
+#ifndef METADATA_ONLY
+  if (ptr) memset(ptr, 0, total);
+#endif
+  return ptr;
+}
+
+/** free_sized - The size is in the header already, so just free. */
+void my_free_sized(void* ptr, size_t size) {
+  assert(!ptr || size <= block_size(block(ptr)) - HEADER_SIZE);
+  my_free(ptr);
+}
+
 /** realloc - Implemented simply in terms of malloc and free */
 void* my_realloc(void* ptr, size_t size) {
   assert(size <= heap_hi - heap_lo);
@@ -472,8 +1246,10 @@ void* my_realloc(void* ptr, size_t size) {
     return NULL;
   }
 
+  meta_reserve();
+
   // Calculate new block size
-  uint32_t size_new = round_up(size);
+  uint32_t size_new = size_fits(size) ? MIN_STORAGE : round_up(size);
 
   block_t* block = block(ptr);
 
@@ -489,9 +1265,8 @@ void* my_realloc(void* ptr, size_t size) {
   uint32_t diff = size_new - block_size(block);
   block_t* right = right(block);
 
-  // Expand if at end of heap
-  if ((uint8_t*)right == heap_hi) {
-    mem_sbrk(diff);
+  // Expand if at end of heap (or move, if the heap can't grow)
+  if ((uint8_t*)right == heap_hi && mem_sbrk(diff) != (void*)-1) {
     heap_hi += diff;
     block_set_size(block, size_new);
     return ptr;
@@ -504,13 +1279,61 @@ void* my_realloc(void* ptr, size_t size) {
   if (!ptr_new) return NULL;
 
   // Copy original data into new block
-  memcpy(ptr_new, ptr, block_size(block) - HEADER_SIZE);
+#ifndef METADATA_ONLY
+  payload_copy(ptr_new, ptr, block_size(block) - HEADER_SIZE);
+#endif
 
   // Free old block
   my_free(ptr);
   return ptr_new;
 }
 
+/**
+ * memalign - Allocate a block whose payload is aligned to the given power of
+ * two. Over-allocates, then splits off the leading part of the block (which
+ * is at least MIN_STORAGE bytes, so it can be a free block of its own) and
+ * frees it, and trims the tail.
+ */
+void* my_memalign(size_t alignment, size_t size) {
+  if (alignment <= ALIGNMENT) return my_malloc(size);
+
+  uint8_t* ptr = allocate(size + alignment + MIN_STORAGE);
+  if (!ptr) return NULL;
+  if (((uintptr_t)ptr & (alignment - 1)) == 0) {
+    shrink(block(ptr), size_fits(size) ? MIN_STORAGE : round_up(size));
+#ifdef HEAP_PROFILE
+    heap_account(ptr, size);
+#endif
+    return ptr;
+  }
+
+  uint8_t* ptr_aligned = (uint8_t*)(((uintptr_t)ptr + MIN_STORAGE +
+                                     alignment - 1) & ~(alignment - 1));
+  block_t* block = block(ptr);
+  block_t* aligned = block(ptr_aligned);
+  uint32_t lead = (uint8_t*)aligned - (uint8_t*)block;
+  uint32_t rest = block_size(block) - lead;
+
+  // Split, and give the new block a clean header
+  block_set_size(block, lead);
+  meta(aligned)->size = 0;
+  block_set_size(aligned, rest);
+  block_update_last(aligned);
+
+  // Free the leading part, then trim the tail
+  coalesce(block);
+  shrink(aligned, size_fits(size) ? MIN_STORAGE : round_up(size));
+#ifdef HEAP_PROFILE
+  heap_account(ptr_aligned, size);
+#endif
+  return ptr_aligned;
+}
+
+/** usable_size - Number of payload bytes in the block at ptr. */
+size_t my_usable_size(void* ptr) {
+  return block_size(block(ptr)) - HEADER_SIZE;
+}
+
 void my_reset_brk() {
   mem_reset_brk();
 }
@@ -35,6 +35,9 @@ typedef struct {
   void *(*malloc)(size_t size);
   void *(*realloc)(void *ptr, size_t size);
   void (*free)(void *ptr);
+  void *(*calloc)(size_t nmemb, size_t size);
+  void *(*memalign)(size_t alignment, size_t size);
+  void (*free_sized)(void *ptr, size_t size);
   int (*check)();
   void (*reset_brk)(void);
   void *(*heap_lo)(void);
@@ -45,42 +48,81 @@ int libc_init();
 void * libc_malloc(size_t size);
 void * libc_realloc(void *ptr, size_t size);
 void libc_free(void *ptr);
+void * libc_calloc(size_t nmemb, size_t size);
+void * libc_memalign(size_t alignment, size_t size);
+void libc_free_sized(void *ptr, size_t size);
 int libc_check();
 void libc_reset_brk();
 void * libc_heap_lo();
 void * libc_heap_hi();
 
+#ifndef MALLOC_SHIM
 static const malloc_impl_t libc_impl =
 { .init = &libc_init, .malloc = &libc_malloc, .realloc = &libc_realloc,
-  .free = &libc_free, .check = &libc_check, .reset_brk = &libc_reset_brk,
+  .free = &libc_free, .calloc = &libc_calloc, .memalign = &libc_memalign,
+  .free_sized = &libc_free_sized, .check = &libc_check, .reset_brk = &libc_reset_brk,
   .heap_lo = &libc_heap_lo, .heap_hi = &libc_heap_hi};
+#endif
 
 int my_init();
 void * my_malloc(size_t size);
 void * my_realloc(void *ptr, size_t size);
 void my_free(void *ptr);
+void * my_calloc(size_t nmemb, size_t size);
+void * my_memalign(size_t alignment, size_t size);
+void my_free_sized(void *ptr, size_t size);
 int my_check();
 void my_reset_brk();
 void * my_heap_lo();
 void * my_heap_hi();
 
+/* Only used by the drop-in library (malloc_shim.c) */
+size_t my_usable_size(void *ptr);
+
+#ifdef COPY_STATS
+/* The copies my_realloc made to move blocks (make COPY_STATS=1) */
+typedef struct {
+  unsigned long moves;           // blocks moved
+  unsigned long bytes;           // bytes copied
+  unsigned long streamed;        // moves copied with non-temporal stores
+  unsigned long streamed_bytes;
+  double secs;                   // time spent copying
+} copy_stats_t;
+
+extern copy_stats_t my_copy_stats;
+#endif
+
+#ifdef HEAP_PROFILE
+/* Write the sampled heap profile to path (NULL: HEAP_PROFILE_OUT, where it
+ * is also written at exit); see allocator.c. Not to be called from inside
+ * the allocator. Returns 0 on success. */
+int my_heap_profile_dump(const char *path);
+#endif
+
 static const malloc_impl_t my_impl =
 { .init = &my_init, .malloc = &my_malloc, .realloc = &my_realloc,
-  .free = &my_free, .check = &my_check, .reset_brk = &my_reset_brk,
+  .free = &my_free, .calloc = &my_calloc, .memalign = &my_memalign,
+  .free_sized = &my_free_sized, .check = &my_check, .reset_brk = &my_reset_brk,
   .heap_lo = &my_heap_lo, .heap_hi = &my_heap_hi};
 
 int bad_init();
 void * bad_malloc(size_t size);
 void * bad_realloc(void *ptr, size_t size);
 void bad_free(void *ptr);
+void * bad_calloc(size_t nmemb, size_t size);
+void * bad_memalign(size_t alignment, size_t size);
+void bad_free_sized(void *ptr, size_t size);
 int bad_check();
 void bad_reset_brk();
 void * bad_heap_lo();
 void * bad_heap_hi();
 
+#ifndef MALLOC_SHIM
 static const malloc_impl_t bad_impl =
 { .init = &bad_init, .malloc = &bad_malloc, .realloc = &bad_realloc,
-  .free = &bad_free, .check = &bad_check, .reset_brk = &bad_reset_brk,
+  .free = &bad_free, .calloc = &bad_calloc, .memalign = &bad_memalign,
+  .free_sized = &bad_free_sized, .check = &bad_check, .reset_brk = &bad_reset_brk,
   .heap_lo = &bad_heap_lo, .heap_hi = &bad_heap_hi};
+#endif
 
 #endif  // _ALLOCATOR_INTERFACE_H
@@ -80,6 +80,20 @@ void * bad_realloc(void *ptr, size_t size) {
   return newptr;
 }
 
+// bad_calloc - Just bad_malloc; lacks the zeroing step.
+void * bad_calloc(size_t nmemb, size_t size) {
+  return bad_malloc(nmemb * size);
+}
+
+// bad_memalign - Just bad_malloc; ignores the alignment.
+void * bad_memalign(size_t alignment, size_t size) {
+  return bad_malloc(size);
+}
+
+// bad_free_sized - Freeing a block does nothing.
+void bad_free_sized(void *ptr, size_t size) {
+  // Do nothing.
+}
 
 // call mem_reset_brk.
 void bad_reset_brk() {
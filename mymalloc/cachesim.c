@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./cachesim.h"
+
+/* One set-associative cache with LRU replacement. The TLB is one too, with
+ * pages as its lines. */
+typedef struct {
+  const char *name;
+  size_t size;       /* bytes (entries, for the TLB) */
+  int ways;
+  int line_bits;     /* log2 of the line (or page) size */
+  size_t num_sets;
+  uint64_t *tags;    /* num_sets * ways; line number + 1, 0 if empty */
+  uint64_t *stamps;  /* last use of each way, for LRU */
+} cache_t;
+
+int cachesim_enabled = 0;
+
+static int line_bits = 6;  /* 64-byte lines */
+static cache_t levels[CACHESIM_LEVELS] = {
+  {"L1", 32 << 10, 8},
+  {"L2", 256 << 10, 8},
+  {"LLC", 8 << 20, 16},
+};
+static cache_t tlb = {"TLB", 64, 4};
+static int page_bits = 12;  /* 4 KB pages */
+
+static uint64_t clock_ticks;
+static cachesim_stats_t stats[CACHESIM_KINDS];
+
+static int log2_exact(size_t n) {
+  int bits = 0;
+  while ((1UL << bits) < n) bits++;
+  return (1UL << bits) == n ? bits : -1;
+}
+
+/* Parses "32K", "8M", "64" */
+static size_t parse_size(const char *s, char **end) {
+  size_t n = strtoul(s, end, 10);
+  switch (**end) {
+    case 'K': case 'k': (*end)++; return n << 10;
+    case 'M': case 'm': (*end)++; return n << 20;
+    case 'G': case 'g': (*end)++; return n << 30;
+  }
+  return n;
+}
+
+static int cache_setup(cache_t *cache, int bits) {
+  size_t lines = cache->size >> (cache == &tlb ? 0 : bits);
+  cache->line_bits = bits;
+  if (lines < (size_t)cache->ways || lines % cache->ways) return -1;
+  cache->num_sets = lines / cache->ways;
+  if (log2_exact(cache->num_sets) < 0) return -1;
+  free(cache->tags);
+  free(cache->stamps);
+  cache->tags = calloc(lines, sizeof(uint64_t));
+  cache->stamps = calloc(lines, sizeof(uint64_t));
+  if (!cache->tags || !cache->stamps) return -1;
+  return 0;
+}
+
+int cachesim_init(const char *spec) {
+  char key[16];
+  const char *s = spec;
+  while (s && *s) {
+    int n = 0;
+    while (*s && *s != '=' && n < (int)sizeof(key) - 1) key[n++] = *s++;
+    key[n] = '\0';
+    if (*s++ != '=') return -1;
+    char *end;
+    size_t value = parse_size(s, &end);
+    if (end == s || (*end && *end != ',')) return -1;
+    s = *end ? end + 1 : end;
+
+    if (!strcmp(key, "l1")) levels[0].size = value;
+    else if (!strcmp(key, "l2")) levels[1].size = value;
+    else if (!strcmp(key, "llc")) levels[2].size = value;
+    else if (!strcmp(key, "tlb")) tlb.size = value;
+    else if (!strcmp(key, "page") && log2_exact(value) > 0) {
+      page_bits = log2_exact(value);
+    } else if (!strcmp(key, "line") && log2_exact(value) > 0) {
+      line_bits = log2_exact(value);
+    } else {
+      return -1;
+    }
+  }
+
+  for (int i = 0; i < CACHESIM_LEVELS; i++) {
+    if (cache_setup(&levels[i], line_bits) < 0) return -1;
+  }
+  if (cache_setup(&tlb, page_bits) < 0) return -1;
+  cachesim_reset();
+  return 0;
+}
+
+void cachesim_describe(void) {
+  printf("Cache simulator: %d-byte lines", 1 << line_bits);
+  for (int i = 0; i < CACHESIM_LEVELS; i++) {
+    printf(", %s %zu KB %d-way", levels[i].name, levels[i].size >> 10,
+           levels[i].ways);
+  }
+  printf(", TLB %zu entries %d-way, %d KB pages\n", tlb.size, tlb.ways,
+         1 << (page_bits - 10));
+}
+
+void cachesim_reset(void) {
+  for (int i = 0; i < CACHESIM_LEVELS; i++) {
+    memset(levels[i].tags, 0,
+           levels[i].num_sets * levels[i].ways * sizeof(uint64_t));
+  }
+  memset(tlb.tags, 0, tlb.num_sets * tlb.ways * sizeof(uint64_t));
+  memset(stats, 0, sizeof(stats));
+  clock_ticks = 0;
+}
+
+/* Looks up a line (or page) number; on a miss, evicts the LRU way of its
+ * set and installs it. Returns whether it hit. */
+static int cache_lookup(cache_t *cache, uint64_t line) {
+  size_t set = line & (cache->num_sets - 1);
+  uint64_t *tags = &cache->tags[set * cache->ways];
+  uint64_t *stamps = &cache->stamps[set * cache->ways];
+  int victim = 0;
+
+  clock_ticks++;
+  for (int w = 0; w < cache->ways; w++) {
+    if (tags[w] == line + 1) {
+      stamps[w] = clock_ticks;
+      return 1;
+    }
+    if (stamps[w] < stamps[victim] || !tags[w]) victim = w;
+    if (!tags[w]) break;
+  }
+  tags[victim] = line + 1;
+  stamps[victim] = clock_ticks;
+  return 0;
+}
+
+void cachesim_access(cachesim_kind kind, uintptr_t addr, size_t size) {
+  cachesim_stats_t *s = &stats[kind];
+  if (!size) return;
+
+  uint64_t first = addr >> line_bits, last = (addr + size - 1) >> line_bits;
+  for (uint64_t line = first; line <= last; line++) {
+    s->accesses++;
+    for (int i = 0; i < CACHESIM_LEVELS; i++) {
+      if (cache_lookup(&levels[i], line)) break;
+      s->misses[i]++;
+    }
+  }
+
+  uint64_t first_page = addr >> page_bits;
+  uint64_t last_page = (addr + size - 1) >> page_bits;
+  for (uint64_t page = first_page; page <= last_page; page++) {
+    s->tlb_accesses++;
+    if (!cache_lookup(&tlb, page)) s->tlb_misses++;
+  }
+}
+
+cachesim_stats_t cachesim_stats(cachesim_kind kind) {
+  return stats[kind];
+}
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+/*
+ * cachesim.h - A deterministic cache and TLB simulator (mdriver -C)
+ *
+ * Three set-associative LRU cache levels and a TLB, fed with address ranges.
+ * Accesses are classified as data (w ops) or metadata (the allocator's
+ * block_t accesses, in a CACHESIM build), and counted separately.
+ */
+
+#ifndef MM_CACHESIM_H
+#define MM_CACHESIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {CACHESIM_DATA, CACHESIM_META, CACHESIM_KINDS} cachesim_kind;
+
+#define CACHESIM_LEVELS 3  /* L1, L2, LLC */
+
+typedef struct {
+  uint64_t accesses;                  /* cache line accesses */
+  uint64_t misses[CACHESIM_LEVELS];   /* misses at each level */
+  uint64_t tlb_accesses;              /* page accesses */
+  uint64_t tlb_misses;
+} cachesim_stats_t;
+
+/* Whether accesses are being simulated; checked by the hooks */
+extern int cachesim_enabled;
+
+/* Configure from a spec such as "l1=32K,l2=256K,llc=8M,page=4K,tlb=64"
+ * (missing keys keep their defaults). Returns 0 on success, -1 if the spec
+ * is malformed. */
+int cachesim_init(const char *spec);
+
+/* Print the configuration */
+void cachesim_describe(void);
+
+/* Empty the caches and the TLB, and zero the statistics */
+void cachesim_reset(void);
+
+/* Simulate touching size bytes at addr */
+void cachesim_access(cachesim_kind kind, uintptr_t addr, size_t size);
+
+cachesim_stats_t cachesim_stats(cachesim_kind kind);
+
+/* For the allocator's meta() hook: record an access, return the pointer */
+static inline void *cachesim_touch(void *ptr, size_t size) {
+  if (cachesim_enabled) {
+    cachesim_access(CACHESIM_META, (uintptr_t)ptr, size);
+  }
+  return ptr;
+}
+
+#endif  // MM_CACHESIM_H
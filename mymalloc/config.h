@@ -26,17 +26,79 @@
 #define MAX_BASE_THROUGHPUT (64000e3) /* in kops/sec */
 
 /*
- * Alignment requirement in bytes (8)
+ * Alignment requirement in bytes (8, or 16 as the x86-64 ABI expects with
+ * make ALIGN16=1). The validator checks every payload against it, and the
+ * allocator aligns to it.
  */
+#ifndef R_ALIGNMENT
 #define R_ALIGNMENT 8
+#endif
 
 /*
- * Maximum heap size in bytes
+ * Maximum heap size in bytes. Can be raised for scaled-up traces, e.g.
+ * make partial_clean mdriver PARAMS="-DMAX_HEAP=4294967296L"
+ * The heap as a whole may pass 4 GB, but a single request must stay below
+ * 2 GB (mem_sbrk takes an int), and the allocator's block sizes are 32 bits.
  */
+#ifndef MAX_HEAP
 #define MAX_HEAP (50*(1<<20))  /* 50 MB */
+#endif
 
 #define MEM_ALLOWANCE (40 * (1 << 10)) /* 40 KB */
 
+/*
+ * Sampled validation (mdriver -s <rate>). Besides the sampled block ids,
+ * every op is fully validated inside windows of VALID_WINDOW_OPS ops, and a
+ * window starts at any given op with probability VALID_WINDOW_PROB.
+ */
+#define VALID_WINDOW_OPS 1024
+#define VALID_WINDOW_PROB (0.0001)
+
+/*
+ * Soak mode (mdriver -S <secs>) reports every SOAK_INTERVAL seconds by
+ * default. A run is flagged if the heap grew by more than SOAK_GROWTH_TOL
+ * over its second half, or if the throughput of its last quarter is more
+ * than SOAK_DECAY_TOL below that of its first quarter.
+ */
+#define SOAK_INTERVAL 10
+#define SOAK_GROWTH_TOL (0.01)
+#define SOAK_DECAY_TOL (0.10)
+
+/*
+ * Cache simulation (mdriver -C <spec>). The w ops of each layout are timed
+ * WRITE_PHASE_RUNS times and the best time is kept. The reference layout
+ * starts on a CACHE_LINE boundary, as our heap does.
+ */
+#define WRITE_PHASE_RUNS 5
+#define CACHE_LINE 64
+
+/*
+ * Benchmark modes (mdriver -M <mode>). Each replay is timed MODE_RUNS times
+ * and the median is kept. Caches are evicted by reading COLD_FLUSH_FACTOR
+ * times the last-level cache, and at least COLD_FLUSH_MIN bytes. pollute
+ * writes POLLUTE_BYTES every MODE_OPS ops by default, and startup times the
+ * first MODE_OPS ops by default.
+ */
+#define MODE_RUNS 11
+#define MODE_OPS 1000
+#define COLD_FLUSH_FACTOR 2
+#define COLD_FLUSH_MIN (32 << 20)
+#define POLLUTE_BYTES (256 << 10)
+
+/*
+ * Profiling (mdriver -P <file>). Each trace is replayed for PROF_SECS
+ * seconds, sampled every PROF_INTERVAL_US of CPU time (the kernel may round
+ * this up to its tick).
+ */
+#define PROF_SECS 2
+#define PROF_INTERVAL_US 1000
+
+/*
+ * eval_mm_speed prefetches the blocks[] slot of the op PREFETCH_OPS ahead of
+ * the one it replays.
+ */
+#define PREFETCH_OPS 8
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
@@ -8,6 +8,7 @@
  * the time in CPU cycles for a function f.
  */
 #include <stdlib.h>
+#include <string.h>
 #include <sys/times.h>
 #include <stdio.h>
 
@@ -109,6 +110,8 @@ static void clear() {
       fprintf(stderr, "Fatal error.  Malloc returned null when trying to clear cache\n");
       exit(1);
     }
+    /* Fault every page in: reads of untouched pages all hit one zero page */
+    memset(cache_buf, 1, cache_bytes);
   }
   cptr = (int *) cache_buf;
   cend = cptr + cache_bytes/sizeof(int);
@@ -119,6 +122,14 @@ static void clear() {
   sink = x;
 }
 
+/*
+ * fcyc_clear_cache - Clear the cache now, as fcyc does before each
+ *     measurement when set_fcyc_clear_cache is set
+ */
+void fcyc_clear_cache(void) {
+  clear();
+}
+
 /*
  * fcyc - Use K-best scheme to estimate the running time of function f
  */
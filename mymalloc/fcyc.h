@@ -18,6 +18,10 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Evict the cache (and the TLB) by reading a buffer of the size set with
+   set_fcyc_cache_size */
+void fcyc_clear_cache(void);
+
 /*********************************************************
  * Set the various parameters used by measurement routines
  *********************************************************/
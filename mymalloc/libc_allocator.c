@@ -61,3 +61,20 @@ void * libc_realloc(void *ptr, size_t size) {
 void libc_free(void *ptr) {
   free(ptr);
 }
+
+/*call default calloc */
+void * libc_calloc(size_t nmemb, size_t size) {
+  return calloc(nmemb, size);
+}
+
+/*call default posix_memalign, which needs at least pointer alignment */
+void * libc_memalign(size_t alignment, size_t size) {
+  void *ptr;
+  if (alignment < sizeof(void *)) alignment = sizeof(void *);
+  return posix_memalign(&ptr, alignment, size) ? NULL : ptr;
+}
+
+/*libc has no sized free, so call default free */
+void libc_free_sized(void *ptr, size_t size) {
+  free(ptr);
+}
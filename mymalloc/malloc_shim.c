@@ -0,0 +1,260 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+/*
+ * malloc_shim.c - the libc allocator API on top of allocator.c, for
+ *                 libmymalloc.so.
+ *
+ *   $ make libmymalloc.so
+ *   $ LD_PRELOAD=./libmymalloc.so ./app
+ *
+ * The heap is memlib's MEMLIB_SYSTEM backend, a large reservation of real
+ * address space. allocator.c is not thread safe, so every call takes one
+ * global lock, which is also held across fork() so the child inherits a
+ * consistent heap. Requests of LARGE_SIZE bytes or more bypass the heap and
+ * get their own mapping, like glibc's mmap threshold; they are told apart
+ * from heap blocks by their address.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "./allocator_interface.h"
+#include "./memlib.h"
+
+#define EXPORT __attribute__ ((visibility ("default")))
+
+/* Requests this big get their own mapping. Must stay well below the largest
+ * block the allocator can hold (4 GB, as sizes are 32 bits). Free blocks
+ * coalesced past that stay apart, and the last bin takes any size. */
+#ifndef LARGE_SIZE
+#define LARGE_SIZE (64 * (1 << 20))
+#endif
+
+/* Header in front of a large block: the mapping's base and length */
+typedef struct {
+  void* base;
+  size_t length;
+} large_t;
+
+#define LARGE_HEADER 16
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int initialized = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+// Large blocks
+
+static int is_large(void* ptr) {
+  return !initialized || (uint8_t*)ptr < (uint8_t*)mem_heap_lo() ||
+         (uint8_t*)ptr > (uint8_t*)mem_heap_hi();
+}
+
+static large_t* large_header(void* ptr) {
+  return (large_t*)((uint8_t*)ptr - LARGE_HEADER);
+}
+
+static void* large_alloc(size_t alignment, size_t size) {
+  if (alignment < LARGE_HEADER) alignment = LARGE_HEADER;
+  size_t length = size + LARGE_HEADER + alignment;
+  length = (length + getpagesize() - 1) & ~((size_t)getpagesize() - 1);
+  if (length < size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  void* base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  uintptr_t ptr = ((uintptr_t)base + LARGE_HEADER + alignment - 1) &
+                  ~(uintptr_t)(alignment - 1);
+  large_header((void*)ptr)->base = base;
+  large_header((void*)ptr)->length = length;
+  return (void*)ptr;
+}
+
+static void large_free(void* ptr) {
+  large_t* header = large_header(ptr);
+  munmap(header->base, header->length);
+}
+
+static size_t large_usable_size(void* ptr) {
+  large_t* header = large_header(ptr);
+  return (uint8_t*)header->base + header->length - (uint8_t*)ptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Locking and fork
+
+/* Called with the lock held */
+static void ensure_init() {
+  if (!initialized) {
+    mem_init();
+    my_init();
+    initialized = 1;
+  }
+}
+
+static void before_fork() {
+  pthread_mutex_lock(&lock);
+}
+
+static void after_fork() {
+  pthread_mutex_unlock(&lock);
+}
+
+static void after_fork_child() {
+  pthread_mutex_init(&lock, NULL);
+}
+
+__attribute__ ((constructor))
+static void shim_init() {
+  pthread_atfork(before_fork, after_fork, after_fork_child);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The exported allocator
+
+EXPORT void* malloc(size_t size) {
+  if (size >= LARGE_SIZE) return large_alloc(0, size);
+
+  pthread_mutex_lock(&lock);
+  ensure_init();
+  void* ptr = my_malloc(size);
+  pthread_mutex_unlock(&lock);
+
+  if (!ptr) errno = ENOMEM;
+  return ptr;
+}
+
+EXPORT void free(void* ptr) {
+  if (!ptr) return;
+  if (is_large(ptr)) {
+    large_free(ptr);
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  my_free(ptr);
+  pthread_mutex_unlock(&lock);
+}
+
+EXPORT void* calloc(size_t n, size_t size) {
+  size_t total = n * size;
+  if (size && total / size != n) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  void* ptr = malloc(total);
+  // Fresh mappings are zeroed already; reused heap blocks are not
+  if (ptr && total < LARGE_SIZE) memset(ptr, 0, total);
+  return ptr;
+}
+
+EXPORT size_t malloc_usable_size(void* ptr) {
+  if (!ptr) return 0;
+  if (is_large(ptr)) return large_usable_size(ptr);
+
+  pthread_mutex_lock(&lock);
+  size_t size = my_usable_size(ptr);
+  pthread_mutex_unlock(&lock);
+  return size;
+}
+
+EXPORT void* realloc(void* ptr, size_t size) {
+  if (!ptr) return malloc(size);
+  if (!size) {
+    free(ptr);
+    return NULL;
+  }
+
+  // Moving between the heap and a mapping of its own
+  size_t old = malloc_usable_size(ptr);
+  if (is_large(ptr) || size >= LARGE_SIZE) {
+    if (is_large(ptr) && size >= LARGE_SIZE / 2 && size <= old) return ptr;
+    void* ptr_new = malloc(size);
+    if (!ptr_new) return NULL;
+    memcpy(ptr_new, ptr, old < size ? old : size);
+    free(ptr);
+    return ptr_new;
+  }
+
+  pthread_mutex_lock(&lock);
+  void* ptr_new = my_realloc(ptr, size);
+  pthread_mutex_unlock(&lock);
+
+  if (!ptr_new) errno = ENOMEM;
+  return ptr_new;
+}
+
+EXPORT int posix_memalign(void** memptr, size_t alignment, size_t size) {
+  if (alignment < sizeof(void*) || (alignment & (alignment - 1))) {
+    return EINVAL;
+  }
+
+  void* ptr;
+  if (size >= LARGE_SIZE || alignment >= LARGE_SIZE) {
+    ptr = large_alloc(alignment, size);
+  } else {
+    pthread_mutex_lock(&lock);
+    ensure_init();
+    ptr = my_memalign(alignment, size);
+    pthread_mutex_unlock(&lock);
+  }
+
+  if (!ptr) return ENOMEM;
+  *memptr = ptr;
+  return 0;
+}
+
+EXPORT void* memalign(size_t alignment, size_t size) {
+  void* ptr = NULL;
+  // memalign accepts any power of two, even below sizeof(void*)
+  if (alignment < sizeof(void*)) alignment = sizeof(void*);
+  int err = posix_memalign(&ptr, alignment, size);
+  if (err) {
+    errno = err;
+    return NULL;
+  }
+  return ptr;
+}
+
+EXPORT void* aligned_alloc(size_t alignment, size_t size) {
+  return memalign(alignment, size);
+}
+
+EXPORT void* valloc(size_t size) {
+  return memalign(getpagesize(), size);
+}
+
+EXPORT void* pvalloc(size_t size) {
+  size_t page = getpagesize();
+  return memalign(page, (size + page - 1) & ~(page - 1));
+}
@@ -10,7 +10,9 @@
  * May not be used, modified, or copied without permission.
  */
 
+#include "./fcyc.h"
 #include "./mdriver.h"
+#include "./profiler.h"
 #include "./validator.h"
 
 #ifdef GET_RUNNINGTIME
@@ -20,6 +22,16 @@
  * Private compound data types
  *****************************/
 
+/* What the annotations of a trace say (see eval_mm_annot) */
+typedef struct {
+  int threads;       /* distinct thread ids, 0 if the trace has no annotations */
+  double busiest;    /* share of the ops made by the busiest thread */
+  int sites;         /* distinct call-site ids */
+  int peak_site;     /* the site holding the most bytes at the peak... */
+  double peak_share; /* ... and its share of the live bytes then */
+  double span_secs;  /* from the first to the last timestamp, 0 if none */
+} annot_stats_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
   /* defined for both libc malloc and student malloc package (mm.c) */
@@ -30,10 +42,26 @@ typedef struct {
 
   /* defined only for the student malloc package */
   double util;     /* space utilization for this trace (always 0 for libc) */
+#ifdef COPY_STATS
+  copy_stats_t copies; /* realloc copies in one run of the trace */
+#endif
+  annot_stats_t annot; /* only with -v */
 
   /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/*
+ * A benchmark mode (mdriver -M): each replay is timed both undisturbed
+ * (the base) and disturbed, on both allocators
+ */
+typedef enum {MODE_COLD, MODE_POLLUTE, MODE_STARTUP} mode_kind_t;
+
+typedef struct {
+  mode_kind_t kind;
+  int ops;     /* pollute every ops ops; or time the first ops ops */
+  long bytes;  /* bytes written per pollution */
+} bench_mode_t;
+
 /********************
  * Global variables
  *******************/
@@ -52,22 +80,30 @@ static const char xor_constant = 0x7B;
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static void pack_trace(trace_t *trace, char *path);
 static void free_trace(trace_t *trace);
 
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static double eval_mm_util(const malloc_impl_t *impl, trace_t *trace, int tracenum);
-static void eval_mm_speed(const malloc_impl_t *impl, trace_t *trace);
-static void eval_my_speed(trace_t *trace) {
-  eval_mm_speed(&my_impl, trace);
-}
-static void eval_libc_speed(trace_t *trace) {
-  eval_mm_speed(&libc_impl, trace);
-}
+static void eval_mm_annot(trace_t *trace, annot_stats_t *stats);
+static void eval_my_speed(trace_t *trace);
+static void eval_libc_speed(trace_t *trace);
 static int eval_mm_check(const malloc_impl_t *impl, trace_t *trace, int tracenum);
+#ifdef METADATA_ONLY
+static void eval_util_only(int n, char **tracefiles);
+#else
+static void eval_mm_soak(int n, char **tracefiles, double secs,
+                         double interval);
+static void eval_mm_cache(int n, char **tracefiles);
+static void eval_mm_mode(int n, char **tracefiles, bench_mode_t *m);
+static void eval_mm_profile(int n, char **tracefiles, char *path);
+#endif
 
 /* Various helper routines */
+static int parse_mode(char *spec, bench_mode_t *m);
 static void printresults(int n, char **tracefiles, stats_t *stats);
+static void print_annotations(int n, stats_t *stats);
 static void usage(void);
 
 /**************
@@ -89,6 +125,13 @@ int main(int argc, char **argv) {
   int run_bad = 0;     /* If set, run bad malloc (set by -b) */
   int check_heap = 0;  /* If set, run the student heap checker (set by -c) */
   int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+  double sample_rate = 1.0; /* fraction of block ids fully validated (-s) */
+  double soak_secs = 0;     /* if set, run soak mode for this long (-S) */
+  double soak_interval = SOAK_INTERVAL; /* soak report interval (-R) */
+  char *cache_spec = NULL;  /* if set, replay in the cache simulator (-C) */
+  char *mode_spec = NULL;   /* if set, cold/polluted/startup timing (-M) */
+  bench_mode_t mode = {MODE_COLD, 0, 0}; /* ... parsed */
+  char *prof_path = NULL;   /* if set, profile and write folded stacks (-P) */
 
   /* temporaries used to compute the performance index */
   double total_throughput, total_util, average_util, average_throughput, p1, p2, perfindex;
@@ -97,7 +140,7 @@ int main(int argc, char **argv) {
   /*
    * Read and interpret the command line arguments
    */
-  while ((c = getopt(argc, argv, "f:t:hvVgcb")) != EOF) {
+  while ((c = getopt(argc, argv, "f:t:s:S:R:C:M:P:hvVgcb")) != EOF) {
     switch (c) {
       case 'g': /* Generate summary info for the autograder */
         autograder = 1;
@@ -117,6 +160,46 @@ int main(int argc, char **argv) {
         if (tracedir[strlen(tracedir)-1] != '/')
           strcat(tracedir, "/"); /* path always ends with "/" */
         break;
+      case 's': /* Fully validate only a sample of the block ids */
+        sample_rate = atof(optarg);
+        if (sample_rate <= 0.0 || sample_rate > 1.0) {
+          usage();
+          exit(1);
+        }
+        break;
+      case 'S': /* Soak: loop over the traces on one heap for this long */
+        soak_secs = atof(optarg);
+        if (soak_secs <= 0.0) {
+          usage();
+          exit(1);
+        }
+        break;
+      case 'R': /* Soak report interval */
+        soak_interval = atof(optarg);
+        if (soak_interval <= 0.0) {
+          usage();
+          exit(1);
+        }
+        break;
+      case 'C': /* Replay in the cache simulator with this configuration */
+        cache_spec = optarg;
+        if (cachesim_init(cache_spec) < 0) {
+          fprintf(stderr, "Bad cache configuration '%s'\n", cache_spec);
+          usage();
+          exit(1);
+        }
+        break;
+      case 'M': /* Time cold-cache, polluted or startup replays */
+        mode_spec = optarg;
+        if (parse_mode(mode_spec, &mode) < 0) {
+          fprintf(stderr, "Bad mode '%s'\n", mode_spec);
+          usage();
+          exit(1);
+        }
+        break;
+      case 'P': /* Profile our allocator; folded stacks to this file */
+        prof_path = optarg;
+        break;
       case 'b': /* Run bad malloc to check the verifier. */
         run_bad = 1;
         break;
@@ -173,6 +256,57 @@ int main(int argc, char **argv) {
     }
   }
 
+#ifdef METADATA_ONLY
+  /*
+   * In a metadata-only build the heap cannot be read or written, so only
+   * the space utilization of the student's mm package is evaluated
+   */
+  if (mode_spec || prof_path) {
+    fprintf(stderr, "-M and -P time the allocator; rebuild without "
+            "SIMULATE=1\n");
+    exit(1);
+  }
+  eval_util_only(num_tracefiles, tracefiles);
+  for (i = 0; i < num_tracefiles; i++) {
+    free(tracefiles[i]);
+  }
+  free(tracefiles);
+  exit(0);
+#else
+  if (soak_secs > 0) {
+    eval_mm_soak(num_tracefiles, tracefiles, soak_secs, soak_interval);
+    for (i = 0; i < num_tracefiles; i++) {
+      free(tracefiles[i]);
+    }
+    free(tracefiles);
+    exit(0);
+  }
+  if (cache_spec) {
+    eval_mm_cache(num_tracefiles, tracefiles);
+    for (i = 0; i < num_tracefiles; i++) {
+      free(tracefiles[i]);
+    }
+    free(tracefiles);
+    exit(0);
+  }
+  if (mode_spec) {
+    eval_mm_mode(num_tracefiles, tracefiles, &mode);
+    for (i = 0; i < num_tracefiles; i++) {
+      free(tracefiles[i]);
+    }
+    free(tracefiles);
+    exit(0);
+  }
+  if (prof_path) {
+    eval_mm_profile(num_tracefiles, tracefiles, prof_path);
+    for (i = 0; i < num_tracefiles; i++) {
+      free(tracefiles[i]);
+    }
+    free(tracefiles);
+    exit(0);
+  }
+#endif
+
   /* Initialize the timing package */
   init_fsecs();
 
@@ -234,7 +368,8 @@ int main(int argc, char **argv) {
       trace = read_trace(tracedir, tracefiles[i]);
       bad_stats[i].ops = trace->num_ops;
       printf("Checking bad malloc for correctness.\n");
-      bad_stats[i].valid = eval_mm_valid(&bad_impl, trace, i);
+      bad_stats[i].valid = eval_mm_valid_sampled(&bad_impl, trace, i,
+                                                 sample_rate);
       if (check_heap) {
         bad_stats[i].checked = eval_mm_check(&bad_impl, trace, i);
       }
@@ -268,7 +403,7 @@ int main(int argc, char **argv) {
     if (verbose > 1) {
       printf("Checking mm_malloc for correctness, ");
     }
-    mm_stats[i].valid = eval_mm_valid(&my_impl, trace, i);
+    mm_stats[i].valid = eval_mm_valid_sampled(&my_impl, trace, i, sample_rate);
     if (check_heap) {
       mm_stats[i].checked = eval_mm_check(&my_impl, trace, i);
     }
@@ -276,7 +411,16 @@ int main(int argc, char **argv) {
       if (verbose > 1) {
         printf("efficiency, ");
       }
+#ifdef COPY_STATS
+      memset(&my_copy_stats, 0, sizeof(my_copy_stats));
+#endif
       mm_stats[i].util = eval_mm_util(&my_impl, trace, i);
+#ifdef COPY_STATS
+      mm_stats[i].copies = my_copy_stats;
+#endif
+      if (verbose && trace->info) {
+        eval_mm_annot(trace, &mm_stats[i].annot);
+      }
       if (verbose > 1) {
         printf("and performance.\n");
       }
@@ -293,6 +437,18 @@ int main(int argc, char **argv) {
     printf("\nResults for mm malloc:\n");
     printresults(num_tracefiles, tracefiles, mm_stats);
     printf("\n");
+#ifdef COPY_STATS
+    printf("Realloc copies for mm malloc:\n");
+    printf("%5s%10s%12s%10s%12s%10s\n", "trace", "moves", "KB",
+           "streamed", "KB", "ms");
+    for (i = 0; i < num_tracefiles; i++) {
+      copy_stats_t *c = &mm_stats[i].copies;
+      printf("%2d%13lu%12lu%10lu%12lu%10.3f\n", i, c->moves, c->bytes / 1024,
+             c->streamed, c->streamed_bytes / 1024, c->secs * 1e3);
+    }
+    printf("\n");
+#endif
+    print_annotations(num_tracefiles, mm_stats);
   }
 
   /*
@@ -372,14 +528,36 @@ int main(int argc, char **argv) {
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * trace_field - the next numeric field of the op being read by read_trace
+ */
+static unsigned trace_field(char *path, unsigned op_index) {
+  char *token = strtok(NULL, " \t\r\n");
+  if (!token || strchr(token, '=')) {
+    printf("Missing field on line %d of tracefile %s\n",
+           LINENUM(op_index), path);
+    exit(1);
+  }
+  return strtoul(token, NULL, 10);
+}
+
+/*
+ * read_trace - read a trace file and store it in memory. Besides the
+ *    classic a, f, r and w ops, the extended grammar has
+ *      c {id} {size}          calloc (size bytes in all, zeroed)
+ *      m {id} {align} {size}  aligned alloc (memalign family)
+ *      F {id} {size}          sized free
+ *    and any op may end with annotations: t={thread id}, s={call-site id}
+ *    and ts={timestamp in ns}. The ops are replayed in trace order, on one
+ *    thread; annotations are kept in trace->info, and mdriver -v
+ *    summarizes them (eval_mm_annot).
  */
 static trace_t *read_trace(char *tracedir, char *filename) {
   FILE *tracefile;
   trace_t *trace;
-  char type[MAXLINE];
+  char line[MAXLINE];
   char path[MAXLINE];
-  unsigned index, size;
+  char *token;
+  unsigned index;
   unsigned max_index = 0;
   unsigned op_index;
 
@@ -409,6 +587,7 @@ static trace_t *read_trace(char *tracedir, char *filename) {
        (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL) {
     unix_error("malloc 2 failed in read_trace");
   }
+  trace->info = NULL;  /* allocated at the first annotation */
 
   /* We'll keep an array of pointers to the allocated blocks here... */
   if ((trace->blocks =
@@ -422,56 +601,144 @@ static trace_t *read_trace(char *tracedir, char *filename) {
     unix_error("malloc 4 failed in read_trace");
   }
 
-  /* read every request line in the trace file */
-  index = 0;
+  /* read every request line in the trace file, one op per line */
   op_index = 0;
-  while (fscanf(tracefile, "%s", type) != EOF) {
-    switch (type[0]) {
+  while (fgets(line, MAXLINE, tracefile) != NULL) {
+    if ((token = strtok(line, " \t\r\n")) == NULL) {
+      continue;  /* blank line (or the end of the header) */
+    }
+    if (op_index >= (unsigned)trace->num_ops) {
+      printf("More ops than the header says in tracefile %s\n", path);
+      exit(1);
+    }
+    traceop_t *op = &trace->ops[op_index];
+    op->size = 0;
+    op->align = 0;
+    switch (token[0]) {
       case 'a':
-        fscanf(tracefile, "%u %u", &index, &size);
-        trace->ops[op_index].type = ALLOC;
-        trace->ops[op_index].index = index;
-        trace->ops[op_index].size = size;
-        max_index = (index > max_index) ? index : max_index;
+        op->type = ALLOC;
+        break;
+      case 'c':
+        op->type = CALLOC;
+        break;
+      case 'm':
+        op->type = MEMALIGN;
         break;
       case 'r':
-        fscanf(tracefile, "%u %u", &index, &size);
-        trace->ops[op_index].type = REALLOC;
-        trace->ops[op_index].index = index;
-        trace->ops[op_index].size = size;
-        max_index = (index > max_index) ? index : max_index;
+        op->type = REALLOC;
         break;
       case 'f':
-        fscanf(tracefile, "%ud", &index);
-        trace->ops[op_index].type = FREE;
-        trace->ops[op_index].index = index;
+        op->type = FREE;
+        break;
+      case 'F':
+        op->type = FREE_SIZED;
         break;
       case 'w':
-        fscanf(tracefile, "%u %u", &index, &size);
-        trace->ops[op_index].type = WRITE;
-        trace->ops[op_index].index = index;
-        trace->ops[op_index].size = size;
+        op->type = WRITE;
         break;
       default:
         printf("Bogus type character (%c) in tracefile %s\n",
-               type[0], path);
+               token[0], path);
         exit(1);
     }
+    index = trace_field(path, op_index);
+    op->index = index;
+    if (op->type == MEMALIGN) {
+      op->align = trace_field(path, op_index);
+      if (op->align <= 0 || (op->align & (op->align - 1))) {
+        printf("Alignment is not a power of two on line %d of tracefile %s\n",
+               LINENUM(op_index), path);
+        exit(1);
+      }
+    }
+    if (op->type != FREE) {
+      op->size = trace_field(path, op_index);
+    }
+    if (op->type == ALLOC || op->type == CALLOC || op->type == MEMALIGN ||
+        op->type == REALLOC) {
+      max_index = (index > max_index) ? index : max_index;
+    }
+
+    /* annotations */
+    while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+      if (!trace->info && (trace->info = (traceop_info_t *)calloc(
+              trace->num_ops, sizeof(traceop_info_t))) == NULL) {
+        unix_error("calloc failed in read_trace");
+      }
+      traceop_info_t *info = &trace->info[op_index];
+      if (!strncmp(token, "t=", 2)) {
+        info->tid = atoi(token + 2);
+      } else if (!strncmp(token, "s=", 2)) {
+        info->site = atoi(token + 2);
+      } else if (!strncmp(token, "ts=", 3)) {
+        info->time = strtoull(token + 3, NULL, 10);
+      } else {
+        printf("Bogus annotation (%s) on line %d of tracefile %s\n",
+               token, LINENUM(op_index), path);
+        exit(1);
+      }
+    }
     op_index++;
   }
   fclose(tracefile);
   assert((int) max_index == trace->num_ids - 1);
   assert(trace->num_ops == (int) op_index);
 
+  pack_trace(trace, path);
   return trace;
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * pack_trace - Build the packed form of the ops that eval_mm_speed replays
+ *    (see packed_op_t). w ops of size 0 or 1 do nothing there, so they are
+ *    dropped, and each run of the others becomes one WRITE op.
+ */
+static void pack_trace(trace_t *trace, char *path) {
+  int num_writes = 0;
+
+  if (trace->num_ids > PACKED_MAX_IDS) {
+    printf("More than %d ids in tracefile %s\n", PACKED_MAX_IDS, path);
+    exit(1);
+  }
+  if ((trace->packed = (packed_op_t *)calloc(
+          trace->num_ops + PREFETCH_OPS, sizeof(packed_op_t))) == NULL ||
+      (trace->writes = (packed_write_t *)malloc(
+          trace->num_ops * sizeof(packed_write_t))) == NULL) {
+    unix_error("malloc failed in pack_trace");
+  }
+
+  trace->num_packed = 0;
+  for (int i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = &trace->ops[i];
+    if (op->type == WRITE) {
+      if (op->size <= 1) continue;
+      trace->writes[num_writes].index = op->index;
+      trace->writes[num_writes].size = op->size;
+      num_writes++;
+      if (trace->num_packed > 0 &&
+          packed_type(trace->packed[trace->num_packed - 1]) == WRITE) {
+        trace->packed[trace->num_packed - 1]++;  /* one more in the run */
+      } else {
+        trace->packed[trace->num_packed++] = pack_op(WRITE, 0, op->index, 1);
+      }
+    } else {
+      trace->packed[trace->num_packed++] = pack_op(
+          op->type, op->align ? __builtin_ctz(op->align) : 0, op->index,
+          op->size);
+    }
+  }
+  /* The padding is prefetched past the end, never replayed */
+}
+
+/*
+ * free_trace - Free the trace record and the arrays it points to, all of
+ *              which were allocated in read_trace() and pack_trace().
  */
 void free_trace(trace_t *trace) {
-  free(trace->ops);         /* free the three arrays... */
+  free(trace->ops);         /* free the arrays... */
+  free(trace->packed);
+  free(trace->writes);
+  free(trace->info);
   free(trace->blocks);
   free(trace->block_sizes);
   free(trace);              /* and the trace record itself... */
@@ -495,8 +762,8 @@ static double eval_mm_util(const malloc_impl_t *impl, trace_t *trace, int tracen
   int i;
   int index;
   int size, newsize, oldsize;
-  int max_total_size = 0;
-  int total_size = 0;
+  long max_total_size = 0;
+  long total_size = 0;
   size_t heap_size = 0;
   char *p;
   char *newp, *oldp;
@@ -510,10 +777,12 @@ static double eval_mm_util(const malloc_impl_t *impl, trace_t *trace, int tracen
   for (i = 0; i < trace->num_ops; i++) {
     switch (trace->ops[i].type) {
       case ALLOC: /* alloc */
+      case CALLOC:
+      case MEMALIGN:
         index = trace->ops[i].index;
         size = trace->ops[i].size;
 
-        if ((p = (char *) impl->malloc(size)) == NULL) {
+        if ((p = (char *) trace_alloc(impl, &trace->ops[i])) == NULL) {
           app_error("malloc failed in eval_mm_util");
         }
 
@@ -553,11 +822,12 @@ static double eval_mm_util(const malloc_impl_t *impl, trace_t *trace, int tracen
         break;
 
       case FREE: /* free */
+      case FREE_SIZED:
         index = trace->ops[i].index;
         size = trace->block_sizes[index];
         p = trace->blocks[index];
 
-        impl->free(p);
+        trace_free(impl, &trace->ops[i], p);
 
         /* Keep track of current total size
          * of all allocated blocks */
@@ -585,52 +855,67 @@ static void mem_op(volatile char *raddr, volatile char *waddr) {
 }
 
 /*
- * eval_mm_speed - This is the function that is used by fcyc()
- *    to measure the running time of the mm malloc package.
+ * replay_packed - Replay the packed ops [from, to) of trace on impl. *wp is
+ *    the next w op to replay, and is advanced past the ones replayed.
+ *
+ *    The driver reads 8 bytes per op and branches once per run of w ops,
+ *    and it prefetches the blocks[] slot that the op PREFETCH_OPS ahead will
+ *    use. It is always inlined, so where impl is a constant the allocator
+ *    calls are direct.
  */
-static void eval_mm_speed(const malloc_impl_t *impl, trace_t *trace) {
-  int i, index, size, newsize;
-  char *p, *newp, *oldp, *block;
-
-  /* Reset the heap and initialize the mm package */
-  mem_reset_brk();
-  if (impl->init() < 0) {
-    app_error("init failed in eval_mm_speed");
-  }
+static inline __attribute__((always_inline))
+void replay_packed(const malloc_impl_t *impl, trace_t *trace, int from,
+                   int to, packed_write_t **wp) {
+  packed_op_t *ops = trace->packed;
+  packed_write_t *w = *wp;
+  char **blocks = trace->blocks;
+  int i, index, size;
+  char *p;
 
   /* Interpret each trace request */
-  for (i = 0; i < trace->num_ops; i++) {
-    switch (trace->ops[i].type) {
+  for (i = from; i < to; i++) {
+    packed_op_t op = ops[i];
+    __builtin_prefetch(&blocks[packed_index(ops[i + PREFETCH_OPS])], 1);
+    index = packed_index(op);
+    size = packed_size(op);
+    switch (packed_type(op)) {
       case ALLOC: /* malloc */
-        index = trace->ops[i].index;
-        size = trace->ops[i].size;
         if ((p = (char *) impl->malloc(size)) == NULL)
           app_error("malloc error in eval_mm_speed");
-        trace->blocks[index] = p;
+        blocks[index] = p;
+        break;
+
+      case CALLOC: /* calloc */
+        if ((p = (char *) impl->calloc(1, size)) == NULL)
+          app_error("calloc error in eval_mm_speed");
+        blocks[index] = p;
+        break;
+
+      case MEMALIGN: /* aligned alloc */
+        if ((p = (char *) impl->memalign(packed_align(op), size)) == NULL)
+          app_error("memalign error in eval_mm_speed");
+        blocks[index] = p;
         break;
 
       case REALLOC: /* realloc */
-        index = trace->ops[i].index;
-        newsize = trace->ops[i].size;
-        oldp = trace->blocks[index];
-        if ((newp = (char *) impl->realloc(oldp, newsize)) == NULL)
+        if ((p = (char *) impl->realloc(blocks[index], size)) == NULL)
           app_error("realloc error in eval_mm_speed");
-        trace->blocks[index] = newp;
+        blocks[index] = p;
         break;
 
       case FREE: /* free */
-        index = trace->ops[i].index;
-        block = trace->blocks[index];
-        impl->free(block);
+        impl->free(blocks[index]);
         break;
 
-      case WRITE: /* write */
-        index = trace->ops[i].index;
-        size = trace->ops[i].size;
-        p = trace->blocks[index];
-        if (size > 1) {
+      case FREE_SIZED: /* sized free */
+        impl->free_sized(blocks[index], size);
+        break;
+
+      case WRITE: /* a run of size w ops */
+        for (packed_write_t *end = w + size; w < end; w++) {
+          p = blocks[w->index];
           /* read bytes, do some computation, and write */
-          for (int offset = 1; offset < size; offset++) {
+          for (int offset = 1; offset < w->size; offset++) {
             mem_op(p + offset - 1, p + offset);
           }
         }
@@ -640,6 +925,167 @@ static void eval_mm_speed(const malloc_impl_t *impl, trace_t *trace) {
         app_error("Nonexistent request type in eval_mm_speed");
     }
   }
+  *wp = w;
+}
+
+static int compare_ints(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+/* Sorts ids[0..n) and removes the duplicates; returns how many are left.
+ * If runs is not NULL, it gets the length of the longest run of one id. */
+static int sort_unique(int *ids, int n, int *runs) {
+  int k = 0, run = 0;
+
+  qsort(ids, n, sizeof(int), compare_ints);
+  if (runs) {
+    *runs = 0;
+  }
+  for (int i = 0; i < n; i++) {
+    run = (i > 0 && ids[i] == ids[i - 1]) ? run + 1 : 1;
+    if (runs && run > *runs) {
+      *runs = run;
+    }
+    if (run == 1) {
+      ids[k++] = ids[i];
+    }
+  }
+  return k;
+}
+
+/*
+ * eval_mm_annot - Summarize the t=, s= and ts= annotations of a trace:
+ *   how many threads made its requests and the share of the busiest one,
+ *   how many call sites, which site held the most bytes at the peak of
+ *   live bytes that eval_mm_util scores against, and the time the recorded
+ *   program took. The ops are still replayed on one thread, in trace
+ *   order; this reports what the replay leaves out.
+ */
+static void eval_mm_annot(trace_t *trace, annot_stats_t *stats) {
+  traceop_info_t *info = trace->info;
+  int n = trace->num_ops;
+  int *ids, *block_site, *block_size;
+  long *site_bytes;
+  long total = 0, peak = 0;
+  int peak_op = -1, busiest, num_sites;
+  uint64_t first = 0, last = 0;
+
+  memset(stats, 0, sizeof(*stats));
+  if ((ids = (int *)malloc(n * sizeof(int))) == NULL ||
+      (block_site = (int *)calloc(trace->num_ids, sizeof(int))) == NULL ||
+      (block_size = (int *)calloc(trace->num_ids, sizeof(int))) == NULL) {
+    unix_error("malloc in eval_mm_annot failed");
+  }
+
+  /* Threads, and the span of the timestamps */
+  for (int i = 0; i < n; i++) {
+    ids[i] = info[i].tid;
+    if (info[i].time) {
+      first = (first && first < info[i].time) ? first : info[i].time;
+      last = last > info[i].time ? last : info[i].time;
+    }
+  }
+  stats->threads = sort_unique(ids, n, &busiest);
+  stats->busiest = (double)busiest / n;
+  stats->span_secs = (last - first) / 1e9;
+
+  /* Sites; ids keeps them sorted, for bsearch */
+  for (int i = 0; i < n; i++) {
+    ids[i] = info[i].site;
+  }
+  num_sites = stats->sites = sort_unique(ids, n, NULL);
+  if ((site_bytes = (long *)calloc(num_sites, sizeof(long))) == NULL) {
+    unix_error("calloc in eval_mm_annot failed");
+  }
+
+  /* The op after which the live bytes peak, as eval_mm_util counts them */
+  for (int i = 0; i < n; i++) {
+    traceop_t *op = &trace->ops[i];
+    switch (op->type) {
+      case ALLOC:
+      case CALLOC:
+      case MEMALIGN:
+      case REALLOC:
+        total += op->size - (op->type == REALLOC ? block_size[op->index] : 0);
+        block_size[op->index] = op->size;
+        if (total > peak) {
+          peak = total;
+          peak_op = i;
+        }
+        break;
+      case FREE:
+      case FREE_SIZED:
+        total -= block_size[op->index];
+        break;
+      default:
+        break;
+    }
+  }
+
+  /* Replay up to it, charging each live block to the site that sized it */
+  memset(block_size, 0, trace->num_ids * sizeof(int));
+  for (int i = 0; i <= peak_op; i++) {
+    traceop_t *op = &trace->ops[i];
+    int *site = (int *)bsearch(&info[i].site, ids, num_sites, sizeof(int),
+                               compare_ints);
+    switch (op->type) {
+      case ALLOC:
+      case CALLOC:
+      case MEMALIGN:
+      case REALLOC:
+        if (op->type == REALLOC) {
+          site_bytes[block_site[op->index]] -= block_size[op->index];
+        }
+        block_site[op->index] = site - ids;
+        block_size[op->index] = op->size;
+        site_bytes[site - ids] += op->size;
+        break;
+      case FREE:
+      case FREE_SIZED:
+        site_bytes[block_site[op->index]] -= block_size[op->index];
+        break;
+      default:
+        break;
+    }
+  }
+  for (int s = 0; s < num_sites; s++) {
+    if (site_bytes[s] > site_bytes[stats->peak_site]) {
+      stats->peak_site = s;
+    }
+  }
+  stats->peak_share = peak ? (double)site_bytes[stats->peak_site] / peak : 0;
+  stats->peak_site = ids[stats->peak_site];
+
+  free(ids);
+  free(block_site);
+  free(block_size);
+  free(site_bytes);
+}
+
+/*
+ * eval_mm_speed - This is the function that is used by fcyc()
+ *    to measure the running time of the mm malloc package.
+ */
+static inline __attribute__((always_inline))
+void eval_mm_speed(const malloc_impl_t *impl, trace_t *trace) {
+  packed_write_t *w = trace->writes;
+
+  /* Reset the heap and initialize the mm package */
+  mem_reset_brk();
+  if (impl->init() < 0) {
+    app_error("init failed in eval_mm_speed");
+  }
+  replay_packed(impl, trace, 0, trace->num_packed, &w);
+}
+
+/* eval_mm_speed specialized for each allocator, as timed by fsecs */
+static void eval_my_speed(trace_t *trace) {
+  eval_mm_speed(&my_impl, trace);
+}
+
+static void eval_libc_speed(trace_t *trace) {
+  eval_mm_speed(&libc_impl, trace);
 }
 
 /*
@@ -647,7 +1093,7 @@ static void eval_mm_speed(const malloc_impl_t *impl, trace_t *trace) {
  *    implementation.  Returns 0 on check failure, and 1 on pass.
  */
 static int eval_mm_check(const malloc_impl_t *impl, trace_t *trace, int tracenum) {
-  int i, index, size, newsize;
+  int i, index, newsize;
   char *p, *newp, *oldp, *block;
 
   /* Reset the heap and initialize the mm package */
@@ -659,9 +1105,10 @@ static int eval_mm_check(const malloc_impl_t *impl, trace_t *trace, int tracenum
   for (i = 0; i < trace->num_ops; i++) {
     switch (trace->ops[i].type) {
       case ALLOC: /* malloc */
+      case CALLOC:
+      case MEMALIGN:
         index = trace->ops[i].index;
-        size = trace->ops[i].size;
-        if ((p = (char *) impl->malloc(size)) == NULL) {
+        if ((p = (char *) trace_alloc(impl, &trace->ops[i])) == NULL) {
           malloc_error(tracenum, i, "impl malloc failed.");
           return 0;
         }
@@ -680,9 +1127,10 @@ static int eval_mm_check(const malloc_impl_t *impl, trace_t *trace, int tracenum
         break;
 
       case FREE: /* free */
+      case FREE_SIZED:
         index = trace->ops[i].index;
         block = trace->blocks[index];
-        impl->free(block);
+        trace_free(impl, &trace->ops[i], block);
         break;
 
       case WRITE: /* write */
@@ -701,11 +1149,703 @@ static int eval_mm_check(const malloc_impl_t *impl, trace_t *trace, int tracenum
   return 1;
 }
 
+#ifdef METADATA_ONLY
+/*
+ * eval_util_only - Evaluate only the space utilization of the student's
+ *    package on each trace, using the metadata-only allocator build
+ */
+static void eval_util_only(int n, char **tracefiles) {
+  int i;
+  double util, total_util = 0;
+  trace_t *trace;
+
+  mem_init();
+  printf("%5s%27s%6s%12s\n", "trace", "filename", "util", "heapsize");
+  for (i = 0; i < n; i++) {
+    trace = read_trace(tracedir, tracefiles[i]);
+    util = eval_mm_util(&my_impl, trace, i);
+    printf("%2d%30s%5.0f%%%12zu\n", i, tracefiles[i], util*100.0,
+           mem_heapsize());
+    total_util += util;
+    free_trace(trace);
+  }
+  mem_deinit();
+
+  printf("# %f (util)\n", 100.0 * UTIL_WEIGHT * total_util/n);
+  printf("util:%f\n", total_util/n);
+}
+#else
+
+/* One soak report, covering the interval since the previous one */
+typedef struct {
+  double secs;      /* since the start of the soak, at the report */
+  double interval;  /* length of the interval */
+  double ops;       /* ops replayed in the interval */
+  size_t heap;      /* heap size at the report */
+  size_t peak_live; /* peak live payload bytes in the interval */
+} soak_sample_t;
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Throughput over the samples that end in [from, to] seconds */
+static double soak_throughput(soak_sample_t *samples, int n, double from,
+                              double to) {
+  double ops = 0, secs = 0;
+  for (int i = 0; i < n; i++) {
+    if (samples[i].secs >= from && samples[i].secs <= to) {
+      ops += samples[i].ops;
+      secs += samples[i].interval;
+    }
+  }
+  return secs > 0 ? ops / secs : 0;
+}
+
+/*
+ * eval_mm_soak - Replay the traces one after another, in a loop, for secs
+ *    seconds on one heap that is never reset, like a long-running process.
+ *    Blocks a trace leaves live are freed at the end of its pass. Every
+ *    interval seconds, report throughput, the heap size, the peak live
+ *    bytes, and fragmentation (the share of the heap that was not live even
+ *    at that peak). At the end, flag heap growth and throughput decay.
+ */
+static void eval_mm_soak(int n, char **tracefiles, double secs,
+                         double interval) {
+  trace_t **traces;
+  soak_sample_t *samples = NULL;
+  int num_samples = 0;
+  double start, last, ops = 0;
+  size_t live = 0, peak_live = 0;
+  long passes = 0;
+  int exhausted = 0;
+  int i, t, id;
+
+  if ((traces = (trace_t **)malloc(n * sizeof(trace_t *))) == NULL) {
+    unix_error("malloc failed in eval_mm_soak");
+  }
+  for (t = 0; t < n; t++) {
+    traces[t] = read_trace(tracedir, tracefiles[t]);
+  }
+
+  mem_init();
+  if (my_impl.init() < 0) {
+    app_error("init failed in eval_mm_soak");
+  }
+
+  printf("Soaking %d trace(s) for %.0f s\n", n, secs);
+  printf("%8s %8s %12s %12s %12s %6s\n", "secs", "passes", "ops/sec",
+         "heap (KB)", "peak (KB)", "frag");
+
+  start = last = now_secs();
+  for (t = 0; ; t = (t + 1) % n) {
+    trace_t *trace = traces[t];
+    for (id = 0; id < trace->num_ids; id++) {
+      trace->blocks[id] = NULL;
+    }
+
+    for (i = 0; i < trace->num_ops && !exhausted; i++) {
+      traceop_t *op = &trace->ops[i];
+      char *p;
+      switch (op->type) {
+        case ALLOC:
+        case CALLOC:
+        case MEMALIGN:
+          if ((p = (char *)trace_alloc(&my_impl, op)) == NULL) {
+            exhausted = 1;
+            break;
+          }
+          trace->blocks[op->index] = p;
+          trace->block_sizes[op->index] = op->size;
+          live += op->size;
+          break;
+        case REALLOC:
+          if ((p = (char *)my_impl.realloc(trace->blocks[op->index],
+                                           op->size)) == NULL) {
+            exhausted = 1;
+            break;
+          }
+          live += op->size - trace->block_sizes[op->index];
+          trace->blocks[op->index] = p;
+          trace->block_sizes[op->index] = op->size;
+          break;
+        case FREE:
+        case FREE_SIZED:
+          trace_free(&my_impl, op, trace->blocks[op->index]);
+          live -= trace->block_sizes[op->index];
+          trace->blocks[op->index] = NULL;
+          break;
+        case WRITE:
+          p = trace->blocks[op->index];
+          for (int offset = 1; offset < op->size; offset++) {
+            mem_op(p + offset - 1, p + offset);
+          }
+          break;
+        default:
+          app_error("Nonexistent request type in eval_mm_soak");
+      }
+      if (live > peak_live) peak_live = live;
+    }
+    ops += i;
+    if (exhausted) {
+      printf("Heap exhausted (MAX_HEAP = %ld bytes) after %.0f s\n",
+             (long)MAX_HEAP, now_secs() - start);
+      break;
+    }
+
+    /* Free what the trace left live, so every pass starts from none */
+    for (id = 0; id < trace->num_ids; id++) {
+      if (trace->blocks[id]) {
+        my_impl.free(trace->blocks[id]);
+        live -= trace->block_sizes[id];
+        ops++;
+      }
+    }
+    passes++;
+
+    double now = now_secs();
+    if (now - last >= interval || now - start >= secs) {
+      soak_sample_t *sample;
+      if ((samples = (soak_sample_t *)realloc(samples, (num_samples + 1) *
+                                              sizeof(soak_sample_t))) == NULL) {
+        unix_error("realloc failed in eval_mm_soak");
+      }
+      sample = &samples[num_samples++];
+      sample->secs = now - start;
+      sample->interval = now - last;
+      sample->ops = ops;
+      sample->heap = mem_heapsize();
+      sample->peak_live = peak_live;
+      printf("%8.0f %8ld %12.0f %12zu %12zu %5.1f%%\n", sample->secs, passes,
+             ops / sample->interval, sample->heap / 1024, peak_live / 1024,
+             100.0 * (1 - (double)peak_live / sample->heap));
+      fflush(stdout);
+      ops = 0;
+      peak_live = 0;
+      last = now;
+      if (now - start >= secs) break;
+    }
+  }
+
+  /* Judge the drift, once there are enough reports to compare */
+  if (exhausted) {
+    printf("FLAG: unbounded heap growth (the heap ran out)\n");
+  } else if (num_samples < 4) {
+    printf("Too few reports to judge drift; use a longer -S or a shorter -R\n");
+  } else {
+    double total = samples[num_samples - 1].secs;
+    size_t heap_mid = samples[0].heap, heap_end = samples[num_samples - 1].heap;
+    for (i = 0; i < num_samples && samples[i].secs <= total / 2; i++) {
+      heap_mid = samples[i].heap;
+    }
+    double growth = (double)(heap_end - heap_mid) / heap_mid;
+    double early = soak_throughput(samples, num_samples, 0, total / 4);
+    double late = soak_throughput(samples, num_samples, total * 3 / 4, total);
+
+    printf("Heap growth over the second half: %.2f%%\n", 100 * growth);
+    printf("Throughput, last vs first quarter: %.0f vs %.0f ops/sec\n",
+           late, early);
+    if (growth > SOAK_GROWTH_TOL) {
+      printf("FLAG: heap still growing (%.2f%% over the second half)\n",
+             100 * growth);
+    }
+    if (early > 0 && late < early * (1 - SOAK_DECAY_TOL)) {
+      printf("FLAG: throughput decay (%.1f%% below the first quarter)\n",
+             100 * (1 - late / early));
+    }
+  }
+
+  free(samples);
+  for (t = 0; t < n; t++) {
+    free_trace(traces[t]);
+  }
+  free(traces);
+  mem_deinit();
+}
+
+/* A w op of a cache replay, at the address it wrote in that layout */
+typedef struct {
+  char *addr;
+  int size;
+} write_op_t;
+
+/*
+ * cache_replay - Replay a trace through impl, feeding the byte range of
+ *    every w op to the cache simulator, and logging it in writes. In a
+ *    CACHESIM build, the allocator reports its own metadata accesses as well.
+ *    Returns the number of w ops.
+ */
+static int cache_replay(const malloc_impl_t *impl, trace_t *trace,
+                        write_op_t *writes) {
+  int num_writes = 0;
+  char *p;
+
+  mem_reset_brk();
+  cachesim_reset();
+  cachesim_enabled = 1;
+  if (impl->init() < 0) {
+    app_error("init failed in eval_mm_cache");
+  }
+  for (int i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = &trace->ops[i];
+    switch (op->type) {
+      case ALLOC:
+      case CALLOC:
+      case MEMALIGN:
+        if ((p = (char *)trace_alloc(impl, op)) == NULL)
+          app_error("malloc error in eval_mm_cache");
+        trace->blocks[op->index] = p;
+        break;
+      case REALLOC:
+        if ((p = (char *)impl->realloc(trace->blocks[op->index],
+                                       op->size)) == NULL)
+          app_error("realloc error in eval_mm_cache");
+        trace->blocks[op->index] = p;
+        break;
+      case FREE:
+      case FREE_SIZED:
+        trace_free(impl, op, trace->blocks[op->index]);
+        break;
+      case WRITE:
+        p = trace->blocks[op->index];
+        cachesim_access(CACHESIM_DATA, (uintptr_t)p, op->size);
+        writes[num_writes].addr = p;
+        writes[num_writes++].size = op->size;
+        break;
+      default:
+        app_error("Nonexistent request type in eval_mm_cache");
+    }
+  }
+  cachesim_enabled = 0;
+  return num_writes;
+}
+
+/*
+ * bump_replay - The reference layout: every malloc and realloc gets fresh
+ *    memory in *buffer, right after the previous one in allocation order,
+ *    and nothing is ever reused. Otherwise like cache_replay; the caller
+ *    frees *buffer once it is done with the logged writes.
+ */
+static int bump_replay(trace_t *trace, write_op_t *writes, char **buffer) {
+  size_t total = CACHE_LINE;
+  int num_writes = 0;
+  char *bump;
+
+  for (int i = 0; i < trace->num_ops; i++) {
+    if (trace->ops[i].type != FREE && trace->ops[i].type != FREE_SIZED &&
+        trace->ops[i].type != WRITE) {
+      total += (trace->ops[i].size + 7) & ~(size_t)7;
+      total += trace->ops[i].align;
+    }
+  }
+  if ((*buffer = (char *)malloc(total)) == NULL) {
+    unix_error("malloc failed in eval_mm_cache");
+  }
+  bump = (char *)(((uintptr_t)*buffer + CACHE_LINE - 1) &
+                  ~(uintptr_t)(CACHE_LINE - 1));
+
+  cachesim_reset();
+  for (int i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = &trace->ops[i];
+    switch (op->type) {
+      case MEMALIGN:
+        bump = (char *)(((uintptr_t)bump + op->align - 1) &
+                        ~(uintptr_t)(op->align - 1));
+        /* fall through */
+      case ALLOC:
+      case CALLOC:
+      case REALLOC:
+        trace->blocks[op->index] = bump;
+        bump += (op->size + 7) & ~(size_t)7;
+        break;
+      case WRITE:
+        cachesim_access(CACHESIM_DATA, (uintptr_t)trace->blocks[op->index],
+                        op->size);
+        writes[num_writes].addr = trace->blocks[op->index];
+        writes[num_writes++].size = op->size;
+        break;
+      default:
+        break;
+    }
+  }
+  return num_writes;
+}
+
+/* Best time, over WRITE_PHASE_RUNS, to redo the logged writes as
+ * eval_mm_speed does them, without any allocator calls in between */
+static double write_phase_secs(write_op_t *writes, int num_writes) {
+  double best = 0;
+  for (int r = 0; r < WRITE_PHASE_RUNS; r++) {
+    double start = now_secs();
+    for (int i = 0; i < num_writes; i++) {
+      char *p = writes[i].addr;
+      for (int offset = 1; offset < writes[i].size; offset++) {
+        mem_op(p + offset - 1, p + offset);
+      }
+    }
+    double secs = now_secs() - start;
+    if (r == 0 || secs < best) best = secs;
+  }
+  return best;
+}
+
+static void print_cache_row(const char *name, cachesim_stats_t *s) {
+  double lines = s->accesses ? (double)s->accesses : 1.0;
+  double pages = s->tlb_accesses ? (double)s->tlb_accesses : 1.0;
+  printf("  %-12s %12lu %8.2f%% %8.2f%% %8.2f%% %8.2f%%\n", name,
+         (unsigned long)s->accesses, 100.0 * s->misses[0] / lines,
+         100.0 * s->misses[1] / lines, 100.0 * s->misses[2] / lines,
+         100.0 * s->tlb_misses / pages);
+}
+
+/* Misses of our layout (data plus metadata) beyond the reference's */
+static void print_placement_row(cachesim_stats_t *data, cachesim_stats_t *meta,
+                                cachesim_stats_t *ref) {
+  printf("  %-12s %12s", "placement", "");
+  for (int l = 0; l < CACHESIM_LEVELS; l++) {
+    printf(" %+9ld", (long)(data->misses[l] + meta->misses[l] -
+                            ref->misses[l]));
+  }
+  printf(" %+9ld\n", (long)(data->tlb_misses + meta->tlb_misses -
+                            ref->tlb_misses));
+}
+
+static void cache_add(cachesim_stats_t *sum, cachesim_stats_t *s) {
+  sum->accesses += s->accesses;
+  for (int l = 0; l < CACHESIM_LEVELS; l++) {
+    sum->misses[l] += s->misses[l];
+  }
+  sum->tlb_accesses += s->tlb_accesses;
+  sum->tlb_misses += s->tlb_misses;
+}
+
+/*
+ * eval_mm_cache - Replay each trace in the cache simulator, once on our
+ *    allocator and once on the bump-pointer reference layout, and report
+ *    miss rates (misses per line or page accessed) at every level. The
+ *    placement row is the extra misses of our layout, metadata included,
+ *    over the reference; since the simulator is deterministic, it changes
+ *    only when placement (or the metadata the allocator touches) does.
+ *    The write phase is the real time the trace's w ops take on each
+ *    layout, on their own, to see how placement shows up on hardware.
+ */
+static void eval_mm_cache(int n, char **tracefiles) {
+  cachesim_stats_t totals[3];  /* data, metadata, reference data */
+  double total_my_secs = 0, total_ref_secs = 0;
+
+  memset(totals, 0, sizeof(totals));
+  mem_init();
+  cachesim_describe();
+#ifndef CACHESIM
+  printf("Metadata accesses are not simulated; rebuild with CACHESIM=1\n");
+#endif
+  printf("  %-12s %12s %9s %9s %9s %9s\n", "", "lines", "L1 miss",
+         "L2 miss", "LLC miss", "TLB miss");
+
+  for (int t = 0; t < n; t++) {
+    trace_t *trace = read_trace(tracedir, tracefiles[t]);
+    cachesim_stats_t s[3];
+    write_op_t *writes;
+    char *buffer;
+    int num_writes;
+    double my_secs, ref_secs;
+
+    if ((writes = (write_op_t *)malloc(trace->num_ops *
+                                       sizeof(write_op_t))) == NULL) {
+      unix_error("malloc failed in eval_mm_cache");
+    }
+    num_writes = cache_replay(&my_impl, trace, writes);
+    s[0] = cachesim_stats(CACHESIM_DATA);
+    s[1] = cachesim_stats(CACHESIM_META);
+    my_secs = write_phase_secs(writes, num_writes);
+    bump_replay(trace, writes, &buffer);
+    s[2] = cachesim_stats(CACHESIM_DATA);
+    ref_secs = write_phase_secs(writes, num_writes);
+    free(buffer);
+    free(writes);
+    for (int k = 0; k < 3; k++) {
+      cache_add(&totals[k], &s[k]);
+    }
+    total_my_secs += my_secs;
+    total_ref_secs += ref_secs;
+
+    printf("%2d %s\n", t, tracefiles[t]);
+    print_cache_row("data", &s[0]);
+    print_cache_row("metadata", &s[1]);
+    print_cache_row("reference", &s[2]);
+    print_placement_row(&s[0], &s[1], &s[2]);
+    if (num_writes) {
+      printf("  write phase: %.3f ms, %.3f ms on the reference layout\n",
+             my_secs * 1e3, ref_secs * 1e3);
+    }
+    free_trace(trace);
+  }
+
+  printf("Total\n");
+  print_cache_row("data", &totals[0]);
+  print_cache_row("metadata", &totals[1]);
+  print_cache_row("reference", &totals[2]);
+  print_placement_row(&totals[0], &totals[1], &totals[2]);
+  printf("  write phase: %.3f ms, %.3f ms on the reference layout\n",
+         total_my_secs * 1e3, total_ref_secs * 1e3);
+  mem_deinit();
+}
+
+static char *pollute_buf;    /* the lines written by pollute() */
+static long pollute_size;
+static long pollute_next;    /* offset of the next line to write */
+
+/* Bytes to read to evict the caches: a multiple of the last-level cache */
+static long flush_bytes(void) {
+  long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (llc <= 0) llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  llc *= COLD_FLUSH_FACTOR;
+  return llc > COLD_FLUSH_MIN ? llc : COLD_FLUSH_MIN;
+}
+
+/* Dirty bytes worth of lines the allocator has not seen for a while */
+static void pollute(long bytes) {
+  for (long b = 0; b < bytes; b += CACHE_LINE) {
+    pollute_buf[pollute_next]++;
+    pollute_next += CACHE_LINE;
+    if (pollute_next >= pollute_size) pollute_next = 0;
+  }
+}
+
+/* Touch the driver's own arrays, so a cold replay only misses on the
+ * allocator's memory */
+static void warm_trace(trace_t *trace) {
+  volatile char sink;
+  for (long i = 0; i < trace->num_packed * (long)sizeof(packed_op_t);
+       i += CACHE_LINE) {
+    sink = ((char *)trace->packed)[i];
+  }
+  for (long i = 0; i < trace->num_ops * (long)sizeof(packed_write_t);
+       i += CACHE_LINE) {
+    sink = ((char *)trace->writes)[i];
+  }
+  for (long i = 0; i < trace->num_ids * (long)sizeof(char *);
+       i += CACHE_LINE) {
+    ((char *)trace->blocks)[i] = 0;
+  }
+  (void)sink;
+}
+
+/* Time one replay of trace in mode m, disturbed or not. Resetting the heap
+ * and disturbing it are not timed. */
+static double mode_run(const malloc_impl_t *impl, trace_t *trace,
+                       bench_mode_t *m, int disturbed) {
+  packed_write_t *w = trace->writes;
+  int n = trace->num_packed;
+  double start, secs = 0;
+
+  mem_reset_brk();
+  if (disturbed && m->kind != MODE_POLLUTE) {
+    fcyc_clear_cache();
+    warm_trace(trace);
+  }
+  start = now_secs();
+  if (impl->init() < 0) {
+    app_error("init failed in eval_mm_mode");
+  }
+  switch (m->kind) {
+    case MODE_COLD:
+      replay_packed(impl, trace, 0, n, &w);
+      break;
+    case MODE_STARTUP:
+      replay_packed(impl, trace, 0, m->ops < n ? m->ops : n, &w);
+      break;
+    case MODE_POLLUTE:
+      for (int i = 0; i < n; i += m->ops) {
+        replay_packed(impl, trace, i, i + m->ops < n ? i + m->ops : n, &w);
+        if (disturbed) {
+          secs += now_secs() - start;
+          pollute(m->bytes);
+          start = now_secs();
+        }
+      }
+      break;
+  }
+  return secs + now_secs() - start;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Median of MODE_RUNS timed replays, after an untimed one */
+static double mode_secs(const malloc_impl_t *impl, trace_t *trace,
+                        bench_mode_t *m, int disturbed) {
+  double secs[MODE_RUNS];
+  mode_run(impl, trace, m, disturbed);
+  for (int r = 0; r < MODE_RUNS; r++) {
+    secs[r] = mode_run(impl, trace, m, disturbed);
+  }
+  qsort(secs, MODE_RUNS, sizeof(double), compare_doubles);
+  return secs[MODE_RUNS / 2];
+}
+
+/*
+ * eval_mm_mode - Time each trace on libc and on our allocator as fcyc does
+ *    with the cache cleared, which the default timing (gettimeofday around
+ *    warm back-to-back runs) never does:
+ *      cold        the whole trace, after evicting the caches and TLB
+ *      pollute=N   the whole trace, writing POLLUTE_BYTES (or the given
+ *                  bytes) of other lines every N ops
+ *      startup=N   init and the first N ops, after evicting the caches
+ *    next to the same replay undisturbed. The driver's own arrays are kept
+ *    warm, and the cache eviction and pollution are not timed. Reports
+ *    Kops/sec (for startup, usecs per replay) and how much the disturbance
+ *    slows each allocator down.
+ */
+static void eval_mm_mode(int n, char **tracefiles, bench_mode_t *mode) {
+  static const char *labels[][2] = {
+    {"warm", "cold"}, {"clean", "polluted"}, {"warm", "cold"}
+  };
+  const malloc_impl_t *impls[2] = {&libc_impl, &my_impl};
+  double totals[2][2];  /* [libc, my][base, disturbed] */
+  bench_mode_t m = *mode;
+
+  memset(totals, 0, sizeof(totals));
+  set_fcyc_cache_size(flush_bytes());
+  set_fcyc_cache_block(CACHE_LINE);
+  pollute_size = flush_bytes();
+  if (m.kind == MODE_POLLUTE) {
+    if ((pollute_buf = (char *)malloc(pollute_size)) == NULL) {
+      unix_error("malloc failed in eval_mm_mode");
+    }
+    memset(pollute_buf, 0, pollute_size);
+  }
+  mem_init();
+
+  if (m.kind == MODE_COLD) {
+    printf("Cold replays: caches evicted by reading %ld MB\n",
+           flush_bytes() >> 20);
+  } else if (m.kind == MODE_POLLUTE) {
+    printf("Polluted replays: %ld bytes written every %d ops\n", m.bytes,
+           m.ops);
+  } else {
+    printf("Startup: init and the first %d ops, caches evicted by reading "
+           "%ld MB\n", m.ops, flush_bytes() >> 20);
+  }
+  printf("%30s %10s %10s %7s %10s %10s %7s\n",
+         m.kind == MODE_STARTUP ? "usecs" : "Kops/sec", "libc", "libc",
+         "", "my", "my", "");
+  printf("%30s %10s %10s %7s %10s %10s %7s\n", "trace",
+         labels[m.kind][0], labels[m.kind][1], "slower",
+         labels[m.kind][0], labels[m.kind][1], "slower");
+  for (int t = 0; t < n; t++) {
+    trace_t *trace = read_trace(tracedir, tracefiles[t]);
+    double ops = trace->num_ops;
+    printf("%30s", tracefiles[t]);
+    for (int a = 0; a < 2; a++) {
+      double base = mode_secs(impls[a], trace, &m, 0);
+      double disturbed = mode_secs(impls[a], trace, &m, 1);
+      totals[a][0] += base;
+      totals[a][1] += disturbed;
+      if (m.kind == MODE_STARTUP) {
+        printf(" %10.1f %10.1f", base * 1e6, disturbed * 1e6);
+      } else {
+        printf(" %10.0f %10.0f", ops / base / 1e3, ops / disturbed / 1e3);
+      }
+      printf(" %6.2fx", disturbed / base);
+    }
+    printf("\n");
+    fflush(stdout);
+    free_trace(trace);
+  }
+
+  printf("Total: libc %.2fx slower, my %.2fx slower; my/libc speed %.2f %s, "
+         "%.2f %s\n", totals[0][1] / totals[0][0],
+         totals[1][1] / totals[1][0], totals[0][0] / totals[1][0],
+         labels[m.kind][0], totals[0][1] / totals[1][1], labels[m.kind][1]);
+  free(pollute_buf);
+  mem_deinit();
+}
+
+/*
+ * eval_mm_profile - Profile our allocator: replay each trace as
+ *    eval_mm_speed does, over and over for PROF_SECS seconds, with the
+ *    sampling profiler on. Prints a flat profile of each trace, by function
+ *    and by line of allocator.c, and writes the stacks of every trace to
+ *    path in folded format (one root frame per trace), for flamegraph.pl.
+ */
+static void eval_mm_profile(int n, char **tracefiles, char *path) {
+  FILE *folded;
+
+  if (profiler_init() < 0) {
+    fprintf(stderr, "Cannot read the symbol table of mdriver\n");
+    exit(1);
+  }
+  if ((folded = fopen(path, "w")) == NULL) {
+    sprintf(msg, "Could not open %s in eval_mm_profile", path);
+    unix_error(msg);
+  }
+  mem_init();
+
+  for (int t = 0; t < n; t++) {
+    trace_t *trace = read_trace(tracedir, tracefiles[t]);
+    long runs = 0;
+    double start = now_secs();
+
+    profiler_start();
+    do {
+      eval_my_speed(trace);
+      runs++;
+    } while (now_secs() - start < PROF_SECS);
+    profiler_stop();
+
+    printf("%2d ", t);
+    profiler_report(tracefiles[t], "allocator.c", folded);
+    if (verbose) {
+      printf("  %ld replays, %.0f Kops/sec\n", runs,
+             runs * trace->num_ops / (now_secs() - start) / 1e3);
+    }
+    free_trace(trace);
+  }
+
+  fclose(folded);
+  mem_deinit();
+}
+#endif
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
 
 
+/* cold, pollute=<n>[,<bytes>] or startup=<n>; returns -1 if malformed */
+static int parse_mode(char *spec, bench_mode_t *m) {
+  char *end = NULL;
+  m->ops = MODE_OPS;
+  m->bytes = POLLUTE_BYTES;
+  if (!strcmp(spec, "cold")) {
+    m->kind = MODE_COLD;
+    return 0;
+  }
+  if (!strncmp(spec, "pollute", 7)) {
+    m->kind = MODE_POLLUTE;
+    spec += 7;
+  } else if (!strncmp(spec, "startup", 7)) {
+    m->kind = MODE_STARTUP;
+    spec += 7;
+  } else {
+    return -1;
+  }
+  if (*spec == '\0') return 0;
+  if (*spec != '=') return -1;
+  m->ops = strtol(spec + 1, &end, 10);
+  if (m->ops <= 0) return -1;
+  if (m->kind == MODE_POLLUTE && *end == ',') {
+    m->bytes = strtol(end + 1, &end, 10);
+    if (m->bytes <= 0) return -1;
+  }
+  return *end == '\0' ? 0 : -1;
+}
+
 /*
  * printresults - prints a performance summary for some malloc package
  */
@@ -765,6 +1905,39 @@ static void printresults(int n, char **tracefiles, stats_t *stats) {
   }
 }
 
+/*
+ * print_annotations - Print what eval_mm_annot found in the annotated
+ *   traces, if any. The recorded Kops/sec is the rate at which the
+ *   recorded program made its requests, from the timestamps.
+ */
+static void print_annotations(int n, stats_t *stats) {
+  int i;
+
+  for (i = 0; i < n && !stats[i].annot.threads; i++) {
+  }
+  if (i == n) {
+    return;
+  }
+  printf("Annotations of the traces (t=, s=, ts=):\n");
+  printf("%5s%9s%9s%8s%11s%8s%10s%10s\n", "trace", "threads", "busiest",
+         "sites", "peak site", "share", "span ms", "rec Kops");
+  for (i = 0; i < n; i++) {
+    annot_stats_t *a = &stats[i].annot;
+    if (!a->threads) {
+      continue;
+    }
+    printf("%5d%9d%8.0f%%%8d%11d%7.0f%%", i, a->threads, a->busiest * 100,
+           a->sites, a->peak_site, a->peak_share * 100);
+    if (a->span_secs > 0) {
+      printf("%10.3f%10.0f\n", a->span_secs * 1e3,
+             stats[i].ops / a->span_secs / 1e3);
+    } else {
+      printf("%10s%10s\n", "-", "-");
+    }
+  }
+  printf("\n");
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -793,7 +1966,7 @@ void malloc_error(int tracenum, int opnum, char *msg) {
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-  fprintf(stderr, "Usage: mdriver [-hvVgc] [-f <file>] [-t <dir>]\n");
+  fprintf(stderr, "Usage: mdriver [-hvVgc] [-f <file>] [-t <dir>] [-s <rate>] [-S <secs> [-R <secs>]] [-C <cache>] [-M <mode>] [-P <file>]\n");
   fprintf(stderr, "Options\n");
   fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
   fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
@@ -801,5 +1974,15 @@ static void usage(void) {
   fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
   fprintf(stderr, "\t-V         Print additional debug info.\n");
   fprintf(stderr, "\t-c         Check the heap after every operation.\n");
+  fprintf(stderr, "\t-s <rate>  Fully validate only a <rate> fraction of blocks.\n");
+  fprintf(stderr, "\t-S <secs>  Soak: replay the traces in a loop on one heap.\n");
+  fprintf(stderr, "\t-R <secs>  Soak report interval.\n");
+  fprintf(stderr, "\t-C <cache> Report simulated cache misses, e.g. -C l1=32K,l2=256K,\n");
+  fprintf(stderr, "\t           llc=8M,tlb=64,page=4K,line=64 (defaults for the rest).\n");
+  fprintf(stderr, "\t-M <mode>  Time replays with cold caches (cold), with <bytes> of\n");
+  fprintf(stderr, "\t           traffic every <n> ops (pollute=<n>[,<bytes>]), or my_init\n");
+  fprintf(stderr, "\t           and the first <n> ops, cold (startup=<n>).\n");
+  fprintf(stderr, "\t-P <file>  Profile our allocator on each trace; write folded\n");
+  fprintf(stderr, "\t           stacks for flame graphs to <file>.\n");
   fprintf(stderr, "\t-h         Print this message.\n");
 }
@@ -31,8 +31,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "./cachesim.h"
 #include "./config.h"
 #include "./fsecs.h"
 #include "./memlib.h"
@@ -47,7 +49,8 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
-typedef enum {ALLOC, FREE, REALLOC, WRITE} traceop_type; /* type of request */
+typedef enum {ALLOC, FREE, REALLOC, WRITE,
+              CALLOC, MEMALIGN, FREE_SIZED} traceop_type; /* type of request */
 /******************************
  * The key compound data types
  *****************************/
@@ -57,8 +60,60 @@ typedef struct {
   traceop_type  type; /* type of request */
   int index;                        /* index for free() to use later */
   int size;                         /* byte size of alloc/realloc request */
+  int align;                        /* alignment of a memalign request */
 } traceop_t;
 
+/* Optional annotations of a trace operation (t=, s= and ts= in the trace) */
+typedef struct {
+  int tid;        /* thread that made the request, 0 if not given */
+  int site;       /* call-site id, 0 if not given */
+  uint64_t time;  /* timestamp in ns, 0 if not given */
+} traceop_info_t;
+
+/*
+ * Packed form of an op, for eval_mm_speed: 8 bytes, with the type in the
+ * top bits, then log2 of the alignment of a MEMALIGN op, the block id and
+ * the size. A run of w ops is one WRITE op whose size is the number of w
+ * ops in the run, and whose id is that of the first one; the w ops
+ * themselves are in trace->writes, in order.
+ */
+typedef uint64_t packed_op_t;
+
+#define PACKED_TYPE_SHIFT  61
+#define PACKED_ALIGN_SHIFT 56
+#define PACKED_INDEX_SHIFT 31
+#define PACKED_INDEX_BITS  25
+#define PACKED_MAX_IDS     (1 << PACKED_INDEX_BITS)
+
+static inline packed_op_t pack_op(traceop_type type, int align_shift,
+                                  int index, int size) {
+  return (packed_op_t)type << PACKED_TYPE_SHIFT |
+         (packed_op_t)align_shift << PACKED_ALIGN_SHIFT |
+         (packed_op_t)index << PACKED_INDEX_SHIFT | (packed_op_t)size;
+}
+
+static inline traceop_type packed_type(packed_op_t op) {
+  return (traceop_type)(op >> PACKED_TYPE_SHIFT);
+}
+
+static inline size_t packed_align(packed_op_t op) {
+  return (size_t)1 << ((op >> PACKED_ALIGN_SHIFT) & 31);
+}
+
+static inline int packed_index(packed_op_t op) {
+  return (op >> PACKED_INDEX_SHIFT) & (PACKED_MAX_IDS - 1);
+}
+
+static inline int packed_size(packed_op_t op) {
+  return op & 0x7FFFFFFF;
+}
+
+/* A w op in the packed form */
+typedef struct {
+  int index;
+  int size;
+} packed_write_t;
+
 /* Holds the information for one trace file*/
 typedef struct {
   int sugg_heapsize;   /* suggested heap size (unused) */
@@ -66,10 +121,37 @@ typedef struct {
   int num_ops;         /* number of distinct requests */
   int weight;          /* weight for this trace (unused) */
   traceop_t *ops;      /* array of requests */
+  traceop_info_t *info;/* their annotations, NULL if the trace has none */
   char **blocks;       /* array of ptrs returned by malloc/realloc... */
   size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+  packed_op_t *packed; /* the ops packed for eval_mm_speed, with w ops... */
+  int num_packed;      /* ... in runs, followed by PREFETCH_OPS padding */
+  packed_write_t *writes; /* the w ops of the runs (of size > 1) */
 } trace_t;
 
+/* Call the allocation function of impl that an ALLOC, CALLOC or MEMALIGN op
+ * stands for */
+static inline void *trace_alloc(const malloc_impl_t *impl, traceop_t *op) {
+  switch (op->type) {
+    case CALLOC:
+      return impl->calloc(1, op->size);
+    case MEMALIGN:
+      return impl->memalign(op->align, op->size);
+    default:
+      return impl->malloc(op->size);
+  }
+}
+
+/* Likewise for FREE and FREE_SIZED ops */
+static inline void trace_free(const malloc_impl_t *impl, traceop_t *op,
+                              void *ptr) {
+  if (op->type == FREE_SIZED) {
+    impl->free_sized(ptr, op->size);
+  } else {
+    impl->free(ptr);
+  }
+}
+
 /*********************
  * Function prototypes
  *********************/
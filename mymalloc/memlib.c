@@ -25,6 +25,7 @@
  *            allows us to interleave calls from the student's malloc package
  *            with the system's malloc package in libc.
  */
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -40,26 +41,79 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */
+#ifdef METADATA_ONLY
+static char *mem_map_base;   /* start of the reservation */
+static size_t mem_map_len;
+#endif
 
 /*
  * mem_init - initialize the memory system model
  */
 void mem_init(void) {
+#ifdef METADATA_ONLY
+  /* the allocator keeps its metadata elsewhere, so only reserve address
+   * space; any access to the simulated heap faults. The heap starts at the
+   * same offset into a page as a malloc'd one (below), so that my_init pads
+   * it the same way and the heap sizes match the real build. */
+  size_t page = sysconf(_SC_PAGESIZE);
+  char *probe = (char *)malloc(MAX_HEAP);
+  size_t offset = probe ? (uintptr_t)probe & (page - 1) : 0;
+  free(probe);
+
+  mem_map_len = MAX_HEAP + page;
+  mem_map_base = (char *)mmap(NULL, mem_map_len, PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                              -1, 0);
+  if (mem_map_base == MAP_FAILED) {
+    fprintf(stderr, "mem_init_vm: mmap error\n");
+    exit(1);
+  }
+  mem_start_brk = mem_map_base + offset;
+#elif defined(MEMLIB_SYSTEM)
+  /* the real heap of a process (libmymalloc.so): reserve MAX_HEAP bytes of
+   * address space up front; pages are only backed once they are touched.
+   * We are malloc here, so libc malloc is not available. */
+  mem_start_brk = (char *)mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                               -1, 0);
+  if (mem_start_brk == MAP_FAILED) {
+    fprintf(stderr, "mem_init_vm: mmap error\n");
+    abort();
+  }
+#else
   /* allocate the storage we will use to model the available VM */
   if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
     fprintf(stderr, "mem_init_vm: malloc error\n");
     exit(1);
   }
+#endif
 
   mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
   mem_brk = mem_start_brk;                  /* heap is empty initially */
+
+#if defined(HUGEPAGE_AWARE) && defined(MADV_HUGEPAGE)
+  /* back the whole 2 MB pages of the heap with transparent hugepages, for
+   * the hugepage-aware placement in allocator.c */
+  if (HUGEPAGE_AWARE) {
+    uintptr_t huge = (uintptr_t)2 << 20;
+    uintptr_t lo = ((uintptr_t)mem_start_brk + huge - 1) & ~(huge - 1);
+    uintptr_t hi = (uintptr_t)mem_max_addr & ~(huge - 1);
+    if (hi > lo) madvise((void *)lo, hi - lo, MADV_HUGEPAGE);
+  }
+#endif
 }
 
 /*
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void) {
+#if defined(METADATA_ONLY)
+  munmap(mem_map_base, mem_map_len);
+#elif defined(MEMLIB_SYSTEM)
+  munmap(mem_start_brk, MAX_HEAP);
+#else
   free(mem_start_brk);
+#endif
 }
 
 /*
@@ -79,7 +133,10 @@ void *mem_sbrk(int incr) {
 
   if ((incr < 0) || (mem_brk > mem_max_addr)) {
     errno = ENOMEM;
+#ifndef MALLOC_SHIM
+    // Not in the shim, which calls us under its lock: stdio may malloc
     fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory... (%ld)\n", mem_heapsize());
+#endif
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-value"
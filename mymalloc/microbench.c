@@ -0,0 +1,334 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+/*
+ * microbench.c - Allocator microbenchmarks
+ *
+ * Isolates single allocation patterns, so that a change can be traced to
+ * the path it sped up or slowed down, which the mixed traces can't show:
+ *
+ *   pair-N      malloc(N) and free it right away
+ *   lifo-N      allocate a batch of N-byte blocks, free it newest first
+ *   fifo-N      allocate a batch of N-byte blocks, free it oldest first
+ *   random-N    allocate a batch of N-byte blocks, free it in random order
+ *   realloc-F   grow one block from 16 bytes to 1 MB by a factor of F
+ *   write-N     malloc(N), write every byte, free
+ *   frag-holes  fill the heap with small blocks between large ones, free
+ *               the small ones, then allocate blocks too big for the holes
+ *   frag-saw    allocate growing sizes, free every other block, then
+ *               allocate the same sizes in reverse
+ *
+ * Every benchmark is timed with fsecs (as mdriver times traces), SAMPLES
+ * times, on a fresh heap each time. We report the minimum and the median
+ * time per op in ns, and the spread (max - min) / min of the samples, for
+ * our allocator and libc's.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./allocator_interface.h"
+#include "./fsecs.h"
+#include "./memlib.h"
+
+int verbose = 0;  /* used by fsecs.c */
+
+#define SAMPLES 7
+#define BATCH 1000
+#define MAX_BATCH 4096
+
+/* One run of a benchmark */
+typedef struct {
+  const malloc_impl_t *impl;
+  const struct bench_t *bench;
+} run_t;
+
+typedef struct bench_t {
+  const char *name;
+  void (*run)(const malloc_impl_t *impl, long arg);
+  long arg;   /* block size, or growth factor in percent */
+  long ops;   /* allocator calls per run, to compute ns/op (computed in
+               * main for realloc growth) */
+} bench_t;
+
+static void *blocks[MAX_BATCH];
+static int order[MAX_BATCH];  /* random permutation of the batch */
+
+static void check(void *ptr) {
+  if (!ptr) {
+    fprintf(stderr, "microbench: out of memory\n");
+    exit(1);
+  }
+}
+
+/***************
+ * The patterns
+ ***************/
+
+#define PAIRS 100000
+#define BATCHES 50
+
+static void pair(const malloc_impl_t *impl, long size) {
+  for (int i = 0; i < PAIRS; i++) {
+    void *ptr = impl->malloc(size);
+    check(ptr);
+    impl->free(ptr);
+  }
+}
+
+static void lifo(const malloc_impl_t *impl, long size) {
+  for (int b = 0; b < BATCHES; b++) {
+    for (int i = 0; i < BATCH; i++) check(blocks[i] = impl->malloc(size));
+    for (int i = BATCH - 1; i >= 0; i--) impl->free(blocks[i]);
+  }
+}
+
+static void fifo(const malloc_impl_t *impl, long size) {
+  for (int b = 0; b < BATCHES; b++) {
+    for (int i = 0; i < BATCH; i++) check(blocks[i] = impl->malloc(size));
+    for (int i = 0; i < BATCH; i++) impl->free(blocks[i]);
+  }
+}
+
+static void random_order(const malloc_impl_t *impl, long size) {
+  for (int b = 0; b < BATCHES; b++) {
+    for (int i = 0; i < BATCH; i++) check(blocks[i] = impl->malloc(size));
+    for (int i = 0; i < BATCH; i++) impl->free(blocks[order[i]]);
+  }
+}
+
+#define REALLOC_START 16
+#define REALLOC_END (1 << 20)
+#define REALLOC_ROUNDS 200
+
+static long realloc_steps(long percent) {
+  long steps = 0;
+  for (long size = REALLOC_START; size < REALLOC_END;
+       size = size * percent / 100) {
+    steps++;
+  }
+  return steps;
+}
+
+static void grow(const malloc_impl_t *impl, long percent) {
+  for (int r = 0; r < REALLOC_ROUNDS; r++) {
+    void *ptr = impl->malloc(REALLOC_START);
+    check(ptr);
+    for (long size = REALLOC_START; size < REALLOC_END;) {
+      size = size * percent / 100;
+      check(ptr = impl->realloc(ptr, size));
+    }
+    impl->free(ptr);
+  }
+}
+
+#define WRITE_BYTES (16 << 20)  /* bytes written per run, for every size */
+
+static void write_block(const malloc_impl_t *impl, long size) {
+  for (long n = 0; n < WRITE_BYTES / size; n++) {
+    char *ptr = impl->malloc(size);
+    check(ptr);
+    memset(ptr, (int)n, size);
+    impl->free(ptr);
+  }
+}
+
+#define FRAG_SMALL 32
+#define FRAG_LARGE 2048
+
+static void frag_holes(const malloc_impl_t *impl, long unused) {
+  // Small blocks at even indices, large ones at odd
+  for (int i = 0; i < MAX_BATCH; i++) {
+    check(blocks[i] = impl->malloc(i % 2 ? FRAG_LARGE : FRAG_SMALL));
+  }
+  for (int i = 0; i < MAX_BATCH; i += 2) impl->free(blocks[i]);
+  // None of these fit a hole
+  for (int i = 0; i < MAX_BATCH; i += 2) {
+    check(blocks[i] = impl->malloc(FRAG_SMALL * 3));
+  }
+  for (int i = 0; i < MAX_BATCH; i++) impl->free(blocks[i]);
+}
+
+static void frag_saw(const malloc_impl_t *impl, long unused) {
+  for (int i = 0; i < MAX_BATCH; i++) {
+    check(blocks[i] = impl->malloc(16 + 8 * (i % 256)));
+  }
+  for (int i = 0; i < MAX_BATCH; i += 2) impl->free(blocks[i]);
+  for (int i = MAX_BATCH - 2; i >= 0; i -= 2) {
+    check(blocks[i] = impl->malloc(16 + 8 * (255 - i % 256)));
+  }
+  for (int i = 0; i < MAX_BATCH; i++) impl->free(blocks[i]);
+}
+
+static bench_t benchmarks[] = {
+  {"pair-16", pair, 16, 2 * PAIRS},
+  {"pair-64", pair, 64, 2 * PAIRS},
+  {"pair-256", pair, 256, 2 * PAIRS},
+  {"pair-4096", pair, 4096, 2 * PAIRS},
+  {"lifo-32", lifo, 32, 2 * BATCHES * BATCH},
+  {"lifo-512", lifo, 512, 2 * BATCHES * BATCH},
+  {"fifo-32", fifo, 32, 2 * BATCHES * BATCH},
+  {"fifo-512", fifo, 512, 2 * BATCHES * BATCH},
+  {"random-32", random_order, 32, 2 * BATCHES * BATCH},
+  {"random-512", random_order, 512, 2 * BATCHES * BATCH},
+  {"realloc-1.5", grow, 150, 0},
+  {"realloc-2", grow, 200, 0},
+  {"write-16", write_block, 16, 2 * (WRITE_BYTES / 16)},
+  {"write-256", write_block, 256, 2 * (WRITE_BYTES / 256)},
+  {"write-4096", write_block, 4096, 2 * (WRITE_BYTES / 4096)},
+  {"write-65536", write_block, 65536, 2 * (WRITE_BYTES / 65536)},
+  {"frag-holes", frag_holes, 0, 3 * MAX_BATCH},
+  {"frag-saw", frag_saw, 0, 3 * MAX_BATCH},
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/**************
+ * Main routine
+ **************/
+
+/* Called by fsecs */
+static void run_once(void *p) {
+  run_t *run = p;
+  run->impl->reset_brk();
+  if (run->impl->init() < 0) {
+    fprintf(stderr, "microbench: init failed\n");
+    exit(1);
+  }
+  run->bench->run(run->impl, run->bench->arg);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Times bench on impl; fills in min and median ns/op, and the spread */
+static void measure(const malloc_impl_t *impl, const bench_t *bench,
+                    double *min, double *median, double *spread) {
+  run_t run = {impl, bench};
+  double ns[SAMPLES];
+  for (int i = 0; i < SAMPLES; i++) {
+    ns[i] = fsecs(run_once, &run) * 1e9 / bench->ops;
+  }
+  qsort(ns, SAMPLES, sizeof(double), compare_doubles);
+  *min = ns[0];
+  *median = ns[SAMPLES / 2];
+  *spread = (ns[SAMPLES - 1] - ns[0]) / ns[0];
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: microbench [-hml] [benchmark-prefix...]\n");
+  fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-m         Only run our allocator.\n");
+  fprintf(stderr, "\t-l         Only run libc malloc.\n");
+  fprintf(stderr, "\t-h         Print this message.\n");
+  fprintf(stderr, "Benchmarks (default: all)\n");
+  for (int i = 0; i < NUM_BENCHMARKS; i++) {
+    fprintf(stderr, "\t%s\n", benchmarks[i].name);
+  }
+}
+
+int main(int argc, char **argv) {
+  int run_my = 1, run_libc = 1;
+  int c;
+
+  while ((c = getopt(argc, argv, "mlh")) != EOF) {
+    switch (c) {
+      case 'm':
+        run_libc = 0;
+        break;
+      case 'l':
+        run_my = 0;
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  if (!run_my && !run_libc) {
+    fprintf(stderr, "microbench: -m and -l exclude each other\n");
+    exit(1);
+  }
+
+  // Same permutation for both allocators
+  srand(1);
+  for (int i = 0; i < BATCH; i++) order[i] = i;
+  for (int i = BATCH - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    int t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+  for (int i = 0; i < NUM_BENCHMARKS; i++) {
+    bench_t *bench = &benchmarks[i];
+    if (bench->run == grow) {
+      bench->ops = REALLOC_ROUNDS * (realloc_steps(bench->arg) + 2);
+    }
+  }
+
+  mem_init();
+  init_fsecs();
+
+  printf("%-12s %10s %10s %7s %10s %10s %7s %7s\n", "benchmark",
+         "my min", "my median", "spread", "libc min", "libc med", "spread",
+         "my/libc");
+  for (int i = 0; i < NUM_BENCHMARKS; i++) {
+    const bench_t *bench = &benchmarks[i];
+    int selected = optind == argc;
+    for (int a = optind; a < argc; a++) {
+      selected |= !strncmp(bench->name, argv[a], strlen(argv[a]));
+    }
+    if (!selected) continue;
+
+    double my_min = 0, my_median = 0, my_spread = 0;
+    double libc_min = 0, libc_median = 0, libc_spread = 0;
+    printf("%-12s", bench->name);
+    if (run_my) {
+      measure(&my_impl, bench, &my_min, &my_median, &my_spread);
+      printf(" %10.2f %10.2f %6.0f%%", my_min, my_median, 100 * my_spread);
+    } else {
+      printf(" %10s %10s %7s", "-", "-", "-");
+    }
+    if (run_libc) {
+      measure(&libc_impl, bench, &libc_min, &libc_median, &libc_spread);
+      printf(" %10.2f %10.2f %6.0f%%", libc_min, libc_median,
+             100 * libc_spread);
+    } else {
+      printf(" %10s %10s %7s", "-", "-", "-");
+    }
+    if (run_my && run_libc) {
+      printf(" %7.2f", my_median / libc_median);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+
+  mem_deinit();
+  return 0;
+}
@@ -0,0 +1,546 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+/*
+ * mtbench.c - Multithreaded allocator benchmarks
+ *
+ * Reimplementations of the classic scalability and false-sharing
+ * benchmarks against malloc_impl_t, each run over a sweep of thread counts:
+ *
+ *   larson        server churn: threads replace random blocks in an array,
+ *                 then hand the array to a new thread, so blocks are freed
+ *                 by threads other than the one that allocated them
+ *   threadtest    each thread repeatedly allocates a batch of small objects
+ *                 and frees them all; the total work is fixed
+ *   cache-thrash  each thread repeatedly allocates one small object, writes
+ *                 it, and frees it (active false sharing)
+ *   cache-scratch like cache-thrash, but each thread starts by freeing an
+ *                 object that the main thread allocated next to the others'
+ *                 (passive false sharing)
+ *   xmalloc       producer threads allocate blocks that paired consumer
+ *                 threads free
+ *
+ * For each thread count we report the time, the throughput in allocator
+ * ops (mallocs and frees) per second, the speedup over one thread, and the
+ * scaling efficiency, i.e. the speedup divided by the number of threads.
+ *
+ * libc malloc is thread safe; our allocator and the bad allocator are not,
+ * so they are run behind one global lock, which is the baseline any
+ * concurrent design has to beat.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./allocator_interface.h"
+#include "./memlib.h"
+
+#define MAX_THREADS 256
+
+/* Cache line size, for the false sharing benchmarks */
+#define LINE_SIZE 64
+
+/**************************
+ * The allocator under test
+ **************************/
+
+static const malloc_impl_t *base_impl;
+static int use_lock;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Set when the allocator returns NULL; every benchmark stops early */
+static volatile int out_of_memory;
+
+static void *bench_malloc(size_t size) {
+  void *ptr;
+  if (use_lock) {
+    pthread_mutex_lock(&lock);
+    ptr = base_impl->malloc(size);
+    pthread_mutex_unlock(&lock);
+  } else {
+    ptr = base_impl->malloc(size);
+  }
+  if (!ptr) out_of_memory = 1;
+  return ptr;
+}
+
+static void bench_free(void *ptr) {
+  if (!ptr) return;
+  if (use_lock) {
+    pthread_mutex_lock(&lock);
+    base_impl->free(ptr);
+    pthread_mutex_unlock(&lock);
+  } else {
+    base_impl->free(ptr);
+  }
+}
+
+/* Per-thread random numbers (xorshift64) */
+static uint32_t next_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x >> 32;
+}
+
+/* Work multiplier (-s) */
+static double scale = 1.0;
+
+static long scaled(long n) {
+  long m = (long)(n * scale);
+  return m > 0 ? m : 1;
+}
+
+/*******************
+ * The benchmarks
+ *
+ * Each runs with nthreads threads and returns the number of allocator ops
+ * its threads made, or -1 if the allocator ran out of memory. Only the
+ * threads are timed: set-up and tear-down on the main thread (such as
+ * Larson's prefill) is neither timed nor counted.
+ *******************/
+
+typedef struct {
+  int id;
+  int nthreads;
+  long ops;     /* out: allocator ops made by this thread */
+  void *data;   /* benchmark specific */
+} thread_arg_t;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Time spent in run_threads, reset for every run of a benchmark */
+static double timed_secs;
+
+static void run_threads(int nthreads, thread_arg_t *args,
+                        void *(*fn)(void *)) {
+  pthread_t threads[MAX_THREADS];
+  double start = now();
+  for (int i = 0; i < nthreads; i++) {
+    args[i].id = i;
+    args[i].nthreads = nthreads;
+    args[i].ops = 0;
+    if (pthread_create(&threads[i], NULL, fn, &args[i])) {
+      fprintf(stderr, "mtbench: pthread_create failed\n");
+      exit(1);
+    }
+  }
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  timed_secs += now() - start;
+}
+
+static long total_ops(int nthreads, thread_arg_t *args) {
+  long ops = 0;
+  for (int i = 0; i < nthreads; i++) ops += args[i].ops;
+  return out_of_memory ? -1 : ops;
+}
+
+/* larson */
+
+#define LARSON_SLOTS 1000
+#define LARSON_MIN 8
+#define LARSON_MAX 512
+#define LARSON_ROUNDS 8
+#define larson_size(r) (LARSON_MIN + (r) % (LARSON_MAX - LARSON_MIN + 1))
+
+typedef struct {
+  void *blocks[LARSON_SLOTS];
+  uint64_t rand;
+} larson_array_t;
+
+static void *larson_thread(void *p) {
+  thread_arg_t *arg = p;
+  larson_array_t *array = arg->data;
+  long n = scaled(100000) / arg->nthreads;
+  for (long i = 0; i < n && !out_of_memory; i++) {
+    uint32_t r = next_rand(&array->rand);
+    int slot = r % LARSON_SLOTS;
+    bench_free(array->blocks[slot]);
+    array->blocks[slot] = bench_malloc(larson_size(r >> 10));
+  }
+  arg->ops = 2 * n;
+  return NULL;
+}
+
+static long larson(int nthreads) {
+  larson_array_t *arrays = calloc(nthreads, sizeof(larson_array_t));
+  thread_arg_t args[MAX_THREADS];
+
+  // Fill the arrays up front, as Larson does, from the main thread
+  for (int t = 0; t < nthreads; t++) {
+    arrays[t].rand = 0x9E3779B97F4A7C15ULL * (t + 1);
+    for (int i = 0; i < LARSON_SLOTS; i++) {
+      uint32_t r = next_rand(&arrays[t].rand);
+      arrays[t].blocks[i] = bench_malloc(larson_size(r));
+    }
+  }
+
+  // Each round's threads inherit the arrays of the round before
+  long ops = 0;
+  for (int round = 0; round < LARSON_ROUNDS && !out_of_memory; round++) {
+    for (int t = 0; t < nthreads; t++) {
+      args[t].data = &arrays[(t + round) % nthreads];
+    }
+    run_threads(nthreads, args, larson_thread);
+    ops += total_ops(nthreads, args);
+  }
+
+  for (int t = 0; t < nthreads; t++) {
+    for (int i = 0; i < LARSON_SLOTS; i++) bench_free(arrays[t].blocks[i]);
+  }
+  free(arrays);
+  return out_of_memory ? -1 : ops;
+}
+
+/* threadtest */
+
+#define THREADTEST_OBJECTS 100000
+#define THREADTEST_SIZE 8
+
+static void *threadtest_thread(void *p) {
+  thread_arg_t *arg = p;
+  long objects = THREADTEST_OBJECTS / arg->nthreads;
+  long iterations = scaled(50);
+  void **batch = malloc(objects * sizeof(void *));
+  for (long i = 0; i < iterations && !out_of_memory; i++) {
+    for (long j = 0; j < objects; j++) batch[j] = bench_malloc(THREADTEST_SIZE);
+    for (long j = 0; j < objects; j++) bench_free(batch[j]);
+    arg->ops += 2 * objects;
+  }
+  free(batch);
+  return NULL;
+}
+
+static long threadtest(int nthreads) {
+  thread_arg_t args[MAX_THREADS];
+  run_threads(nthreads, args, threadtest_thread);
+  return total_ops(nthreads, args);
+}
+
+/* cache-thrash and cache-scratch */
+
+#define CACHE_SIZE 8
+#define CACHE_WRITES 100
+
+static void *cache_thread(void *p) {
+  thread_arg_t *arg = p;
+  long iterations = scaled(200000) / arg->nthreads;
+
+  // cache-scratch: free the object the main thread gave us first
+  if (arg->data) {
+    bench_free(arg->data);
+    arg->ops++;
+  }
+
+  for (long i = 0; i < iterations && !out_of_memory; i++) {
+    volatile char *obj = bench_malloc(CACHE_SIZE);
+    if (!obj) break;
+    for (int w = 0; w < CACHE_WRITES; w++) {
+      for (int k = 0; k < CACHE_SIZE; k++) obj[k]++;
+    }
+    bench_free((void *)obj);
+  }
+  arg->ops += 2 * iterations;
+  return NULL;
+}
+
+static long cache_thrash(int nthreads) {
+  thread_arg_t args[MAX_THREADS];
+  for (int t = 0; t < nthreads; t++) args[t].data = NULL;
+  run_threads(nthreads, args, cache_thread);
+  return total_ops(nthreads, args);
+}
+
+static long cache_scratch(int nthreads) {
+  thread_arg_t args[MAX_THREADS];
+  // Small neighbouring objects, likely sharing cache lines
+  for (int t = 0; t < nthreads; t++) args[t].data = bench_malloc(CACHE_SIZE);
+  run_threads(nthreads, args, cache_thread);
+  return total_ops(nthreads, args);
+}
+
+/* xmalloc */
+
+#define XMALLOC_RING 1024
+#define XMALLOC_MIN 8
+#define XMALLOC_MAX 512
+#define xmalloc_size(r) (XMALLOC_MIN + (r) % (XMALLOC_MAX - XMALLOC_MIN + 1))
+
+/* Single-producer single-consumer ring shared by a pair of threads */
+typedef struct {
+  void *slots[XMALLOC_RING];
+  volatile long head __attribute__ ((aligned (LINE_SIZE)));  /* next to pop */
+  volatile long tail __attribute__ ((aligned (LINE_SIZE)));  /* next to push */
+  volatile int done;
+} ring_t;
+
+static int ring_push(ring_t *ring, void *ptr) {
+  long tail = ring->tail;
+  if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == XMALLOC_RING) {
+    return 0;
+  }
+  ring->slots[tail % XMALLOC_RING] = ptr;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static void *ring_pop(ring_t *ring) {
+  long head = ring->head;
+  if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) return NULL;
+  void *ptr = ring->slots[head % XMALLOC_RING];
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return ptr;
+}
+
+static void *xmalloc_producer(void *p) {
+  thread_arg_t *arg = p;
+  ring_t *ring = arg->data;
+  uint64_t rand = 0x9E3779B97F4A7C15ULL * (arg->id + 1);
+  long n = scaled(400000) / arg->nthreads;
+  for (long i = 0; i < n && !out_of_memory; i++) {
+    void *ptr = bench_malloc(xmalloc_size(next_rand(&rand)));
+    if (!ptr) break;
+    while (!ring_push(ring, ptr)) sched_yield();
+    arg->ops++;
+  }
+  __atomic_store_n(&ring->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void *xmalloc_consumer(void *p) {
+  thread_arg_t *arg = p;
+  ring_t *ring = arg->data;
+  for (;;) {
+    void *ptr = ring_pop(ring);
+    if (ptr) {
+      bench_free(ptr);
+      arg->ops++;
+    } else if (__atomic_load_n(&ring->done, __ATOMIC_ACQUIRE)) {
+      // The producer may have pushed between our pop and its done flag
+      if (!(ptr = ring_pop(ring))) break;
+      bench_free(ptr);
+      arg->ops++;
+    } else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+/* Thread pairs; a lone thread (one thread, or the odd one out) produces
+ * into its own ring and drains it when full */
+static void *xmalloc_single(void *p) {
+  thread_arg_t *arg = p;
+  ring_t *ring = arg->data;
+  uint64_t rand = 0x9E3779B97F4A7C15ULL * (arg->id + 1);
+  long n = scaled(400000) / arg->nthreads;
+  for (long i = 0; i < n && !out_of_memory; i++) {
+    void *ptr = bench_malloc(xmalloc_size(next_rand(&rand)));
+    if (!ptr) break;
+    if (!ring_push(ring, ptr)) {
+      void *old;
+      while ((old = ring_pop(ring))) bench_free(old);
+      ring_push(ring, ptr);
+    }
+  }
+  void *ptr;
+  while ((ptr = ring_pop(ring))) bench_free(ptr);
+  arg->ops = 2 * n;
+  return NULL;
+}
+
+static void *xmalloc_thread(void *p) {
+  thread_arg_t *arg = p;
+  int paired = arg->nthreads - arg->nthreads % 2;
+  if (arg->id >= paired) return xmalloc_single(p);
+  return arg->id % 2 ? xmalloc_consumer(p) : xmalloc_producer(p);
+}
+
+static long xmalloc(int nthreads) {
+  thread_arg_t args[MAX_THREADS];
+  ring_t *rings = calloc((nthreads + 1) / 2, sizeof(ring_t));
+  for (int t = 0; t < nthreads; t++) args[t].data = &rings[t / 2];
+  run_threads(nthreads, args, xmalloc_thread);
+  free(rings);
+  return total_ops(nthreads, args);
+}
+
+/**************
+ * Main routine
+ **************/
+
+typedef struct {
+  const char *name;
+  long (*run)(int nthreads);
+} benchmark_t;
+
+static const benchmark_t benchmarks[] = {
+  {"larson", larson},
+  {"threadtest", threadtest},
+  {"cache-thrash", cache_thrash},
+  {"cache-scratch", cache_scratch},
+  {"xmalloc", xmalloc},
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static void run_benchmark(const benchmark_t *bench, int *sweep, int nsweep) {
+  printf("%s\n", bench->name);
+  printf("%8s %10s %12s %8s %10s\n", "threads", "secs", "Mops/sec",
+         "speedup", "efficiency");
+
+  double base = 0;
+  for (int i = 0; i < nsweep; i++) {
+    int nthreads = sweep[i];
+
+    // Fresh heap for every run, as in mdriver
+    base_impl->reset_brk();
+    if (base_impl->init() < 0) {
+      fprintf(stderr, "mtbench: init failed\n");
+      exit(1);
+    }
+    out_of_memory = 0;
+    timed_secs = 0;
+
+    long ops = bench->run(nthreads);
+    double secs = timed_secs;
+
+    if (ops < 0) {
+      printf("%8d %10s\n", nthreads, "out of memory");
+      continue;
+    }
+    // Per-thread throughput of the first run is the baseline
+    double throughput = ops / secs;
+    if (!base) base = throughput / nthreads;
+    printf("%8d %10.3f %12.2f %8.2f %9.0f%%\n", nthreads, secs,
+           throughput / 1e6, throughput / base,
+           100 * throughput / (base * nthreads));
+  }
+  printf("\n");
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: mtbench [-hlb] [-t <list>] [-s <scale>] [benchmark...]\n");
+  fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-l         Run libc malloc instead of ours.\n");
+  fprintf(stderr, "\t-b         Run bad malloc instead of ours.\n");
+  fprintf(stderr, "\t-t <list>  Thread counts, e.g. 1,2,4,8 (default: powers of\n");
+  fprintf(stderr, "\t           two up to the number of CPUs).\n");
+  fprintf(stderr, "\t-s <scale> Multiply the work of each benchmark by <scale>.\n");
+  fprintf(stderr, "\t-h         Print this message.\n");
+  fprintf(stderr, "Benchmarks (default: all)\n");
+  for (int i = 0; i < NUM_BENCHMARKS; i++) {
+    fprintf(stderr, "\t%s\n", benchmarks[i].name);
+  }
+}
+
+int main(int argc, char **argv) {
+  int sweep[MAX_THREADS];
+  int nsweep = 0;
+  int c;
+
+  base_impl = &my_impl;
+  use_lock = 1;
+
+  while ((c = getopt(argc, argv, "lbt:s:h")) != EOF) {
+    switch (c) {
+      case 'l':
+        base_impl = &libc_impl;
+        use_lock = 0;
+        break;
+      case 'b':
+        base_impl = &bad_impl;
+        use_lock = 1;
+        break;
+      case 't': {
+        char *s = optarg;
+        nsweep = 0;
+        while (*s && nsweep < MAX_THREADS) {
+          int n = strtol(s, &s, 10);
+          if (n < 1 || n > MAX_THREADS || (*s && *s != ',')) {
+            fprintf(stderr, "mtbench: bad thread list '%s'\n", optarg);
+            exit(1);
+          }
+          sweep[nsweep++] = n;
+          if (*s) s++;
+        }
+        break;
+      }
+      case 's':
+        scale = atof(optarg);
+        if (scale <= 0) {
+          fprintf(stderr, "mtbench: scale must be positive\n");
+          exit(1);
+        }
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      default:
+        usage();
+        exit(1);
+    }
+  }
+
+  if (!nsweep) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int n = 1; n <= cpus && n <= MAX_THREADS; n *= 2) sweep[nsweep++] = n;
+  }
+
+  mem_init();
+  const char *name = base_impl == &libc_impl ? "libc" :
+                     base_impl == &bad_impl ? "bad" : "our";
+  printf("%s malloc%s\n\n", name, use_lock ? ", behind a global lock" : "");
+
+  int ran = 0;
+  for (int i = 0; i < NUM_BENCHMARKS; i++) {
+    int selected = optind == argc;
+    for (int a = optind; a < argc; a++) {
+      selected |= !strcmp(argv[a], benchmarks[i].name);
+    }
+    if (selected) {
+      run_benchmark(&benchmarks[i], sweep, nsweep);
+      ran++;
+    }
+  }
+  if (!ran) {
+    usage();
+    exit(1);
+  }
+
+  mem_deinit();
+  return 0;
+}
@@ -0,0 +1,414 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+/*
+ * profiler.c - A sampling CPU profiler (see profiler.h)
+ *
+ * The handler only copies the interrupted stack (from glibc's backtrace,
+ * which unwinds through the signal frame) into a preallocated array; all
+ * symbolization happens in profiler_report. The interrupted pc is taken
+ * from the signal context, and the frames above it (the handler's own) are
+ * dropped.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <elf.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "./config.h"
+#include "./profiler.h"
+
+#define PROF_DEPTH 32             /* frames kept per sample */
+#define PROF_MAX_SAMPLES 65536    /* later samples are dropped */
+#define PROF_TOP 15               /* rows of each table */
+
+typedef struct {
+  int depth;
+  void *pcs[PROF_DEPTH];  /* pcs[0] is the interrupted pc, then callers */
+} prof_sample_t;
+
+/* A function of the executable */
+typedef struct {
+  uintptr_t start, end;
+  const char *name;
+} prof_symbol_t;
+
+/* A row of a flat profile */
+typedef struct {
+  char *name;
+  long self, total;
+} prof_row_t;
+
+/* The rows, which own their names */
+typedef struct {
+  prof_row_t *rows;
+  int num_rows, size;
+} prof_table_t;
+
+static prof_sample_t *samples;
+static volatile long num_samples;
+static volatile long dropped;
+
+static char exe_path[PATH_MAX];
+static uintptr_t exe_bias;         /* load address of a PIE */
+static prof_symbol_t *symbols;     /* sorted by start */
+static int num_symbols;
+
+/**********
+ * Sampling
+ **********/
+
+static void *interrupted_pc(void *context) {
+#if defined(__x86_64__)
+  return (void *)((ucontext_t *)context)->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+  return (void *)((ucontext_t *)context)->uc_mcontext.gregs[REG_EIP];
+#else
+  return NULL;
+#endif
+}
+
+static void prof_handler(int sig, siginfo_t *info, void *context) {
+  void *pcs[PROF_DEPTH + 8];
+  void *pc = interrupted_pc(context);
+  int n, first;
+
+  if (num_samples >= PROF_MAX_SAMPLES) {
+    dropped++;
+    return;
+  }
+  n = backtrace(pcs, PROF_DEPTH + 8);
+  /* Skip the handler and the signal trampoline */
+  for (first = 0; first < n && pcs[first] != pc; first++) {}
+  if (first == n) first = n < 2 ? n : 2;
+
+  prof_sample_t *s = &samples[num_samples];
+  s->depth = 0;
+  for (int i = first; i < n && s->depth < PROF_DEPTH; i++) {
+    s->pcs[s->depth++] = pcs[i];
+  }
+  num_samples++;
+}
+
+/*****************
+ * The symbol table
+ *****************/
+
+static int compare_symbols(const void *a, const void *b) {
+  const prof_symbol_t *x = a, *y = b;
+  return (x->start > y->start) - (x->start < y->start);
+}
+
+/* Reads the function symbols of the executable; the file stays mapped, as
+ * the names point into it */
+static int load_symbols(void) {
+  struct stat st;
+  Dl_info dl;
+  ssize_t len;
+  int fd;
+
+  if ((len = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1)) < 0) {
+    return -1;
+  }
+  exe_path[len] = '\0';
+  if ((fd = open(exe_path, O_RDONLY)) < 0) return -1;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  char *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) return -1;
+
+  Elf64_Ehdr *ehdr = (Elf64_Ehdr *)image;
+  if (st.st_size < (off_t)sizeof(Elf64_Ehdr) ||
+      memcmp(ehdr->e_ident, ELFMAG, SELFMAG) ||
+      ehdr->e_ident[EI_CLASS] != ELFCLASS64) {
+    return -1;
+  }
+  Elf64_Shdr *shdrs = (Elf64_Shdr *)(image + ehdr->e_shoff);
+  for (int i = 0; i < ehdr->e_shnum; i++) {
+    if (shdrs[i].sh_type != SHT_SYMTAB) continue;
+    Elf64_Sym *syms = (Elf64_Sym *)(image + shdrs[i].sh_offset);
+    const char *strtab = image + shdrs[shdrs[i].sh_link].sh_offset;
+    int n = shdrs[i].sh_size / sizeof(Elf64_Sym);
+    if ((symbols = (prof_symbol_t *)malloc(n * sizeof(prof_symbol_t)))
+        == NULL) {
+      return -1;
+    }
+    for (int k = 0; k < n; k++) {
+      if (ELF64_ST_TYPE(syms[k].st_info) != STT_FUNC ||
+          syms[k].st_shndx == SHN_UNDEF || syms[k].st_size == 0) {
+        continue;
+      }
+      symbols[num_symbols].start = syms[k].st_value;
+      symbols[num_symbols].end = syms[k].st_value + syms[k].st_size;
+      symbols[num_symbols].name = strtab + syms[k].st_name;
+      num_symbols++;
+    }
+  }
+  if (num_symbols == 0) return -1;  /* stripped */
+  qsort(symbols, num_symbols, sizeof(prof_symbol_t), compare_symbols);
+
+  /* Symbol values of a PIE are relative to where it was loaded */
+  if (ehdr->e_type == ET_DYN && dladdr((void *)load_symbols, &dl)) {
+    exe_bias = (uintptr_t)dl.dli_fbase;
+  }
+  return 0;
+}
+
+/* Name of the function containing pc */
+static const char *symbolize(uintptr_t pc) {
+  Dl_info dl;
+  int lo = 0, hi = num_symbols - 1;
+  uintptr_t addr = pc - exe_bias;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (addr < symbols[mid].start) {
+      hi = mid - 1;
+    } else if (addr >= symbols[mid].end) {
+      lo = mid + 1;
+    } else {
+      return symbols[mid].name;
+    }
+  }
+  if (dladdr((void *)pc, &dl)) {
+    if (dl.dli_sname) return dl.dli_sname;
+    if (dl.dli_fname) {  /* a local function of a library */
+      const char *base = strrchr(dl.dli_fname, '/');
+      return base ? base + 1 : dl.dli_fname;
+    }
+  }
+  return "??";
+}
+
+/* The pc to symbolize for frame i: callers' return addresses point after
+ * the call instruction */
+static uintptr_t frame_pc(prof_sample_t *s, int i) {
+  return (uintptr_t)s->pcs[i] - (i > 0);
+}
+
+/***********
+ * Interface
+ ***********/
+
+int profiler_init(void) {
+  struct sigaction sa;
+  void *warm[1];
+
+  if (load_symbols() < 0) return -1;
+  if ((samples = (prof_sample_t *)malloc(PROF_MAX_SAMPLES *
+                                         sizeof(prof_sample_t))) == NULL) {
+    return -1;
+  }
+  /* The first backtrace loads libgcc, which must not happen in the
+   * handler */
+  backtrace(warm, 1);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = prof_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  return sigaction(SIGPROF, &sa, NULL);
+}
+
+static void set_timer(long usecs) {
+  struct itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = usecs;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+void profiler_start(void) {
+  num_samples = 0;
+  dropped = 0;
+  set_timer(PROF_INTERVAL_US);
+}
+
+long profiler_stop(void) {
+  set_timer(0);
+  return num_samples;
+}
+
+/***********
+ * Reporting
+ ***********/
+
+static prof_row_t *find_row(prof_table_t *t, const char *name) {
+  for (int i = 0; i < t->num_rows; i++) {
+    if (!strcmp(t->rows[i].name, name)) return &t->rows[i];
+  }
+  if (t->num_rows == t->size) {
+    t->size = t->size ? 2 * t->size : 64;
+    if ((t->rows = (prof_row_t *)realloc(t->rows, t->size *
+                                         sizeof(prof_row_t))) == NULL) {
+      fprintf(stderr, "profiler: out of memory\n");
+      exit(1);
+    }
+  }
+  prof_row_t *row = &t->rows[t->num_rows++];
+  row->name = strdup(name);
+  row->self = row->total = 0;
+  return row;
+}
+
+static void free_table(prof_table_t *t) {
+  for (int i = 0; i < t->num_rows; i++) free(t->rows[i].name);
+  free(t->rows);
+}
+
+static int compare_rows(const void *a, const void *b) {
+  const prof_row_t *x = a, *y = b;
+  if (x->self != y->self) return (y->self > x->self) - (y->self < x->self);
+  return (y->total > x->total) - (y->total < x->total);
+}
+
+/* Functions by self and total samples */
+static void report_functions(long n) {
+  prof_table_t t = {NULL, 0, 0};
+
+  for (long k = 0; k < n; k++) {
+    prof_sample_t *s = &samples[k];
+    const char *names[PROF_DEPTH];
+    for (int i = 0; i < s->depth; i++) {
+      names[i] = symbolize(frame_pc(s, i));
+      int seen = 0;  /* count recursive functions once per sample */
+      for (int j = 0; j < i && !seen; j++) seen = !strcmp(names[j], names[i]);
+      if (!seen) find_row(&t, names[i])->total++;
+    }
+    if (s->depth > 0) find_row(&t, names[0])->self++;
+  }
+  qsort(t.rows, t.num_rows, sizeof(prof_row_t), compare_rows);
+  printf("  %8s %8s  %s\n", "self", "total", "function");
+  for (int i = 0; i < t.num_rows && i < PROF_TOP && t.rows[i].self > 0; i++) {
+    printf("  %7.2f%% %7.2f%%  %s\n", 100.0 * t.rows[i].self / n,
+           100.0 * t.rows[i].total / n, t.rows[i].name);
+  }
+  free_table(&t);
+}
+
+/* Source lines of the interrupted pcs, from addr2line */
+static void report_lines(long n, const char *source) {
+  char tmp[] = "/tmp/mdriver-prof-XXXXXX";
+  char command[PATH_MAX + 64];
+  char line[PATH_MAX + 64];
+  prof_table_t t = {NULL, 0, 0};
+  size_t len = strlen(source);
+  FILE *in, *out;
+  int fd;
+
+  if ((fd = mkstemp(tmp)) < 0) return;
+  if ((out = fdopen(fd, "w")) == NULL) {
+    close(fd);
+    unlink(tmp);
+    return;
+  }
+  for (long k = 0; k < n; k++) {
+    fprintf(out, "%lx\n", (unsigned long)(frame_pc(&samples[k], 0) -
+                                          exe_bias));
+  }
+  fclose(out);
+  snprintf(command, sizeof(command), "addr2line -e '%s' < %s", exe_path, tmp);
+  if ((in = popen(command, "r")) == NULL) {
+    unlink(tmp);
+    return;
+  }
+  while (fgets(line, sizeof(line), in)) {
+    char *base = strrchr(line, '/');
+    base = base ? base + 1 : line;
+    line[strcspn(line, " \n")] = '\0';  /* drop " (discriminator N)" */
+    if (!strncmp(base, source, len) && base[len] == ':') {
+      find_row(&t, base)->self++;
+    }
+  }
+  pclose(in);
+  unlink(tmp);
+
+  qsort(t.rows, t.num_rows, sizeof(prof_row_t), compare_rows);
+  printf("  %8s  %s\n", "self", "line");
+  for (int i = 0; i < t.num_rows && i < PROF_TOP; i++) {
+    printf("  %7.2f%%  %s\n", 100.0 * t.rows[i].self / n, t.rows[i].name);
+  }
+  free_table(&t);
+}
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Stacks, one line each with its count: title;outermost;...;innermost n */
+static void report_folded(long n, const char *title, FILE *folded) {
+  char **stacks = (char **)malloc(n * sizeof(char *));
+  if (!stacks) return;
+
+  for (long k = 0; k < n; k++) {
+    size_t size = strlen(title) + 1, len;
+    for (int i = 0; i < samples[k].depth; i++) {
+      size += strlen(symbolize(frame_pc(&samples[k], i))) + 1;
+    }
+    if ((stacks[k] = (char *)malloc(size)) == NULL) {
+      fprintf(stderr, "profiler: out of memory\n");
+      exit(1);
+    }
+    strcpy(stacks[k], title);
+    len = strlen(title);
+    for (int i = samples[k].depth - 1; i >= 0; i--) {
+      len += sprintf(stacks[k] + len, ";%s",
+                     symbolize(frame_pc(&samples[k], i)));
+    }
+  }
+  qsort(stacks, n, sizeof(char *), compare_strings);
+  for (long k = 0; k < n;) {
+    long run = 1;
+    while (k + run < n && !strcmp(stacks[k], stacks[k + run])) run++;
+    fprintf(folded, "%s %ld\n", stacks[k], run);
+    k += run;
+  }
+  for (long k = 0; k < n; k++) free(stacks[k]);
+  free(stacks);
+}
+
+void profiler_report(const char *title, const char *source, FILE *folded) {
+  long n = num_samples;
+
+  printf("%s: %ld samples", title, n);
+  if (dropped) printf(", %ld dropped", (long)dropped);
+  printf("\n");
+  if (n == 0) return;
+  report_functions(n);
+  report_lines(n, source);
+  if (folded) report_folded(n, title, folded);
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+/*
+ * profiler.h - A sampling CPU profiler (mdriver -P)
+ *
+ * While started, an ITIMER_PROF timer interrupts the process every
+ * PROF_INTERVAL_US of CPU time, and the SIGPROF handler records the stack
+ * it interrupted. Samples are symbolized against the executable's symbol
+ * table (and dladdr for shared libraries), and against source lines with
+ * addr2line, only when a report is printed.
+ */
+
+#ifndef MM_PROFILER_H
+#define MM_PROFILER_H
+
+#include <stdio.h>
+
+/* Load the executable's symbols and install the SIGPROF handler. Returns 0
+ * on success, -1 if the symbol table cannot be read. */
+int profiler_init(void);
+
+/* Discard the samples so far and start sampling */
+void profiler_start(void);
+
+/* Stop sampling; returns the number of samples since profiler_start */
+long profiler_stop(void);
+
+/* Print a flat profile of the samples since profiler_start: functions by
+ * self and total samples, and the source lines of files named source (a
+ * basename, such as "allocator.c") by samples. If folded is not NULL, also
+ * write the stacks to it in the folded format of flame graph tools, each
+ * under a root frame named title. */
+void profiler_report(const char *title, const char *source, FILE *folded);
+
+#endif  // MM_PROFILER_H
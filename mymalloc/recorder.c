@@ -0,0 +1,512 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+/*
+ * recorder.c - LD_PRELOAD library that records the allocations of an
+ *              unmodified program.
+ *
+ * Wraps malloc, calloc, realloc, free and the memalign family, and logs every
+ * call as a record_t (see recorder.h). Each block gets a stable id, which
+ * follows it through reallocs. Records are buffered in per-thread logs and
+ * appended to the output file in binary when a log fills, when its thread
+ * exits, and at process exit. tools/convert.py turns the output into an
+ * mdriver trace.
+ *
+ *   $ make librecorder.so
+ *   $ LD_PRELOAD=./librecorder.so MALLOC_TRACE_OUT=app.bin ./app
+ *   $ tools/convert.py app.bin > trace_app
+ *
+ * Environment:
+ *   MALLOC_TRACE_OUT    output file (default malloc_trace.<pid>.bin); a
+ *                       forked child writes to <file>.<pid>
+ *   MALLOC_TRACE_SITES  if set to 1, record the caller's return address
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "./recorder.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+
+#define LOG_RECORDS 4096        // records per thread log
+#define MAP_SHARDS 64           // independently locked shards of the id map
+#define MAP_INIT_CAPACITY 1024  // initial slots per shard
+#define BOOTSTRAP_SIZE (1 << 16)
+
+#define EXPORT __attribute__ ((visibility ("default")))
+
+////////////////////////////////////////////////////////////////////////////////
+// Types
+
+/* One thread's buffer of records */
+typedef struct log_t {
+  record_t records[LOG_RECORDS];
+  size_t count;
+  int in_use;           // owned by a live thread
+  struct log_t* next;   // all logs ever created
+} log_t;
+
+/* Pointer -> block id, open addressed with linear probing */
+typedef struct {
+  uintptr_t key;        // 0 if empty
+  uint64_t id;
+} slot_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  slot_t* slots;
+  size_t capacity;
+  size_t count;
+} shard_t;
+
+////////////////////////////////////////////////////////////////////////////////
+// Globals
+
+static void* (*real_malloc)(size_t);
+static void* (*real_calloc)(size_t, size_t);
+static void* (*real_realloc)(void*, size_t);
+static void (*real_free)(void*);
+static void* (*real_memalign)(size_t, size_t);
+static int (*real_posix_memalign)(void**, size_t, size_t);
+static void* (*real_aligned_alloc)(size_t, size_t);
+
+/* calloc requests made by dlsym while the real functions are resolved */
+static char bootstrap[BOOTSTRAP_SIZE];
+static size_t bootstrap_used;
+static int resolving;
+
+static int enabled;               // recording has been set up
+static int record_sites;          // MALLOC_TRACE_SITES
+static int out_fd = -1;
+static char out_path[4096];
+
+static uint64_t next_seq;
+static uint64_t next_id = 1;
+
+static shard_t shards[MAP_SHARDS];
+
+static log_t* all_logs;
+static pthread_mutex_t logs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t log_key;
+
+/* initial-exec, so that touching them never calls back into malloc */
+#define TLS __thread __attribute__ ((tls_model ("initial-exec")))
+
+static TLS log_t* thread_log;
+static TLS uint32_t thread_id;
+static TLS int busy;              // inside the recorder, don't record
+
+////////////////////////////////////////////////////////////////////////////////
+// Resolving the real allocator
+
+static void resolve() {
+  if (real_malloc || resolving) return;
+  resolving = 1;
+  real_calloc = dlsym(RTLD_NEXT, "calloc");
+  real_realloc = dlsym(RTLD_NEXT, "realloc");
+  real_free = dlsym(RTLD_NEXT, "free");
+  real_memalign = dlsym(RTLD_NEXT, "memalign");
+  real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+  real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+  real_malloc = dlsym(RTLD_NEXT, "malloc");
+  resolving = 0;
+}
+
+static void* bootstrap_alloc(size_t size) {
+  size = (size + 15) & ~(size_t)15;
+  if (bootstrap_used + size > BOOTSTRAP_SIZE) return NULL;
+  void* p = bootstrap + bootstrap_used;
+  bootstrap_used += size;
+  return p;
+}
+
+static int is_bootstrap(void* p) {
+  return (char*)p >= bootstrap && (char*)p < bootstrap + BOOTSTRAP_SIZE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The pointer -> id map
+
+static uint64_t hash_ptr(uintptr_t key) {
+  return (key >> 4) * 0x9E3779B97F4A7C15ULL;
+}
+
+static shard_t* shard_of(uintptr_t key) {
+  return &shards[hash_ptr(key) >> 58];
+}
+
+static slot_t* map_slots(size_t capacity) {
+  void* p = mmap(NULL, capacity * sizeof(slot_t), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "recorder: out of memory for the id map\n");
+    abort();
+  }
+  return p;
+}
+
+/* Insert into a shard whose lock is held */
+static void shard_put(shard_t* shard, uintptr_t key, uint64_t id) {
+  if (2 * (shard->count + 1) > shard->capacity) {
+    slot_t* old = shard->slots;
+    size_t old_capacity = shard->capacity;
+    shard->capacity = old_capacity ? 2 * old_capacity : MAP_INIT_CAPACITY;
+    shard->slots = map_slots(shard->capacity);
+    shard->count = 0;
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (old[i].key) shard_put(shard, old[i].key, old[i].id);
+    }
+    if (old) munmap(old, old_capacity * sizeof(slot_t));
+  }
+
+  size_t mask = shard->capacity - 1;
+  size_t i = hash_ptr(key) & mask;
+  while (shard->slots[i].key) {
+    i = (i + 1) & mask;
+  }
+  shard->slots[i].key = key;
+  shard->slots[i].id = id;
+  shard->count++;
+}
+
+static void map_put(void* ptr, uint64_t id) {
+  shard_t* shard = shard_of((uintptr_t)ptr);
+  pthread_mutex_lock(&shard->lock);
+  shard_put(shard, (uintptr_t)ptr, id);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/* Remove ptr from the map and return its id, or 0 if it was not recorded */
+static uint64_t map_take(void* ptr) {
+  uintptr_t key = (uintptr_t)ptr;
+  shard_t* shard = shard_of(key);
+  uint64_t id = 0;
+
+  pthread_mutex_lock(&shard->lock);
+  if (shard->capacity) {
+    size_t mask = shard->capacity - 1;
+    size_t i = hash_ptr(key) & mask;
+    while (shard->slots[i].key && shard->slots[i].key != key) {
+      i = (i + 1) & mask;
+    }
+    if (shard->slots[i].key) {
+      id = shard->slots[i].id;
+      shard->count--;
+
+      // Backward-shift deletion keeps probe sequences unbroken
+      size_t j = i;
+      while (1) {
+        shard->slots[i].key = 0;
+        uintptr_t k;
+        do {
+          j = (j + 1) & mask;
+          k = shard->slots[j].key;
+          if (!k) goto done;
+        } while (((j - (hash_ptr(k) & mask)) & mask) <
+                 ((j - i) & mask));
+        shard->slots[i] = shard->slots[j];
+        i = j;
+      }
+    }
+  }
+done:
+  pthread_mutex_unlock(&shard->lock);
+  return id;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Logs
+
+static void log_flush(log_t* log) {
+  if (!log->count || out_fd < 0) return;
+  pthread_mutex_lock(&write_lock);
+  const char* p = (const char*)log->records;
+  size_t left = log->count * sizeof(record_t);
+  while (left) {
+    ssize_t n = write(out_fd, p, left);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    p += n;
+    left -= n;
+  }
+  pthread_mutex_unlock(&write_lock);
+  log->count = 0;
+}
+
+/* pthread key destructor: flush the log of an exiting thread for reuse */
+static void log_release(void* arg) {
+  log_t* log = arg;
+  log_flush(log);
+  pthread_mutex_lock(&logs_lock);
+  log->in_use = 0;
+  pthread_mutex_unlock(&logs_lock);
+}
+
+static log_t* log_get() {
+  if (thread_log) return thread_log;
+
+  pthread_mutex_lock(&logs_lock);
+  log_t* log;
+  for (log = all_logs; log; log = log->next) {
+    if (!log->in_use) break;
+  }
+  if (!log) {
+    log = mmap(NULL, sizeof(log_t), PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (log == MAP_FAILED) {
+      fprintf(stderr, "recorder: out of memory for a thread log\n");
+      abort();
+    }
+    log->next = all_logs;
+    all_logs = log;
+  }
+  log->in_use = 1;
+  log->count = 0;
+  pthread_mutex_unlock(&logs_lock);
+
+  thread_log = log;
+  thread_id = (uint32_t)syscall(SYS_gettid);
+  pthread_setspecific(log_key, log);
+  return log;
+}
+
+static void record(uint8_t type, uint64_t id, uint64_t size, uint64_t align,
+                   void* site) {
+  log_t* log = log_get();
+  record_t* r = &log->records[log->count];
+  r->seq = __sync_fetch_and_add(&next_seq, 1);
+  r->id = id;
+  r->size = size;
+  r->align = align;
+  r->site = record_sites ? (uint64_t)(uintptr_t)site : 0;
+  r->tid = thread_id;
+  r->type = type;
+  memset(r->pad, 0, sizeof(r->pad));
+  if (++log->count == LOG_RECORDS) {
+    log_flush(log);
+  }
+}
+
+/* Record a new block returned by the real allocator */
+static void record_new(uint8_t type, void* ptr, size_t size, size_t align,
+                       void* site) {
+  if (!ptr || !enabled || busy) return;
+  busy = 1;
+  uint64_t id = __sync_fetch_and_add(&next_id, 1);
+  map_put(ptr, id);
+  record(type, id, size, align, site);
+  busy = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Setup and teardown
+
+static void open_output(int forked) {
+  const char* path = getenv("MALLOC_TRACE_OUT");
+  char name[4096];
+  if (!path) {
+    snprintf(name, sizeof(name), "malloc_trace.%d.bin", (int)getpid());
+  } else if (forked) {
+    snprintf(name, sizeof(name), "%s.%d", path, (int)getpid());
+  } else {
+    snprintf(name, sizeof(name), "%s", path);
+  }
+  strcpy(out_path, name);
+  out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (out_fd < 0) {
+    fprintf(stderr, "recorder: cannot open %s: %s\n", out_path,
+            strerror(errno));
+  }
+}
+
+/* In a forked child, drop the parent's buffered records (the parent writes
+ * them), reinitialize the locks that before_fork() took, and start a log
+ * file of its own */
+static void after_fork_child() {
+  for (log_t* log = all_logs; log; log = log->next) {
+    log->count = 0;
+    if (log != thread_log) log->in_use = 0;
+  }
+  pthread_mutex_init(&logs_lock, NULL);
+  pthread_mutex_init(&write_lock, NULL);
+  for (int i = 0; i < MAP_SHARDS; i++) {
+    pthread_mutex_init(&shards[i].lock, NULL);
+  }
+  if (out_fd >= 0) close(out_fd);
+  open_output(1);
+}
+
+static void before_fork() {
+  pthread_mutex_lock(&logs_lock);
+  pthread_mutex_lock(&write_lock);
+  for (int i = 0; i < MAP_SHARDS; i++) {
+    pthread_mutex_lock(&shards[i].lock);
+  }
+}
+
+static void after_fork_parent() {
+  for (int i = MAP_SHARDS - 1; i >= 0; i--) {
+    pthread_mutex_unlock(&shards[i].lock);
+  }
+  pthread_mutex_unlock(&write_lock);
+  pthread_mutex_unlock(&logs_lock);
+}
+
+__attribute__ ((constructor))
+static void recorder_init() {
+  busy = 1;
+  resolve();
+  for (int i = 0; i < MAP_SHARDS; i++) {
+    pthread_mutex_init(&shards[i].lock, NULL);
+  }
+  pthread_key_create(&log_key, log_release);
+  pthread_atfork(before_fork, after_fork_parent, after_fork_child);
+  const char* sites = getenv("MALLOC_TRACE_SITES");
+  record_sites = sites && atoi(sites);
+  open_output(0);
+  enabled = out_fd >= 0;
+  busy = 0;
+}
+
+__attribute__ ((destructor))
+static void recorder_fini() {
+  busy = 1;
+  enabled = 0;
+  pthread_mutex_lock(&logs_lock);
+  for (log_t* log = all_logs; log; log = log->next) {
+    log_flush(log);
+  }
+  pthread_mutex_unlock(&logs_lock);
+  if (out_fd >= 0) close(out_fd);
+  out_fd = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The interposed allocator
+
+EXPORT void* malloc(size_t size) {
+  resolve();
+  if (!real_malloc) return bootstrap_alloc(size);
+  void* p = real_malloc(size);
+  record_new(REC_MALLOC, p, size, 0, __builtin_return_address(0));
+  return p;
+}
+
+EXPORT void* calloc(size_t n, size_t size) {
+  resolve();
+  if (!real_calloc) return bootstrap_alloc(n * size);  // static, so zeroed
+  void* p = real_calloc(n, size);
+  record_new(REC_CALLOC, p, n * size, 0, __builtin_return_address(0));
+  return p;
+}
+
+EXPORT void free(void* ptr) {
+  if (!ptr || is_bootstrap(ptr)) return;
+  resolve();
+  if (enabled && !busy) {
+    // Record before the address can be handed out again
+    busy = 1;
+    uint64_t id = map_take(ptr);
+    if (id) record(REC_FREE, id, 0, 0, __builtin_return_address(0));
+    busy = 0;
+  }
+  real_free(ptr);
+}
+
+EXPORT void* realloc(void* ptr, size_t size) {
+  resolve();
+  if (!ptr) {
+    void* p = real_realloc(NULL, size);
+    record_new(REC_MALLOC, p, size, 0, __builtin_return_address(0));
+    return p;
+  }
+  if (is_bootstrap(ptr)) {
+    void* p = malloc(size);
+    if (p) memcpy(p, ptr, size);  // the bootstrap arena is large enough
+    return p;
+  }
+  if (!enabled || busy) return real_realloc(ptr, size);
+
+  busy = 1;
+  uint64_t id = map_take(ptr);
+  busy = 0;
+  void* p = real_realloc(ptr, size);
+  busy = 1;
+  if (!id) {
+    // Not one of ours; start following it from here
+    busy = 0;
+    record_new(REC_MALLOC, p, size, 0, __builtin_return_address(0));
+    return p;
+  }
+  if (p) {
+    map_put(p, id);
+    record(REC_REALLOC, id, size, 0, __builtin_return_address(0));
+  } else if (size == 0) {
+    record(REC_FREE, id, 0, 0, __builtin_return_address(0));
+  } else {
+    map_put(ptr, id);  // failed, the old block is still live
+  }
+  busy = 0;
+  return p;
+}
+
+EXPORT void* memalign(size_t alignment, size_t size) {
+  resolve();
+  void* p = real_memalign(alignment, size);
+  record_new(REC_MEMALIGN, p, size, alignment, __builtin_return_address(0));
+  return p;
+}
+
+EXPORT int posix_memalign(void** memptr, size_t alignment, size_t size) {
+  resolve();
+  int ret = real_posix_memalign(memptr, alignment, size);
+  if (ret == 0) {
+    record_new(REC_MEMALIGN, *memptr, size, alignment, __builtin_return_address(0));
+  }
+  return ret;
+}
+
+EXPORT void* aligned_alloc(size_t alignment, size_t size) {
+  resolve();
+  void* p = real_aligned_alloc(alignment, size);
+  record_new(REC_MEMALIGN, p, size, alignment, __builtin_return_address(0));
+  return p;
+}
+
+EXPORT void* valloc(size_t size) {
+  return memalign(getpagesize(), size);
+}
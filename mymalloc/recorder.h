@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef MM_RECORDER_H
+#define MM_RECORDER_H
+
+#include <stdint.h>
+
+/* Record types. tools/convert.py must agree with these. */
+#define REC_MALLOC   'a'
+#define REC_FREE     'f'
+#define REC_REALLOC  'r'
+#define REC_CALLOC   'c'
+#define REC_MEMALIGN 'm'
+
+/* One recorded allocator call, as written to the binary log. The log is a
+ * plain array of these in host byte order; records of different threads are
+ * interleaved in blocks, and seq gives the global order. */
+typedef struct {
+  uint64_t seq;     // global order of the call
+  uint64_t id;      // stable block id, starting at 1
+  uint64_t size;    // requested bytes (n * size for calloc, 0 for free)
+  uint64_t align;   // requested alignment (memalign family), else 0
+  uint64_t site;    // caller's return address if MALLOC_TRACE_SITES=1
+  uint32_t tid;     // kernel thread id
+  uint8_t type;     // one of REC_*
+  uint8_t pad[3];
+} record_t;
+
+#endif  // MM_RECORDER_H
@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+/*
+ * replay.c - Throughput of traces compiled to C by tools/trace2c.py
+ *
+ * mdriver's eval_mm_speed interprets the trace: a switch per op, calls
+ * through malloc_impl_t and loads from trace->blocks. Compiled traces call
+ * the allocator directly, from loops over runs of ops and straight-line
+ * code in between. Each trace is timed with fsecs, as mdriver times it, on
+ * our allocator and libc's; compare the Kops/sec to mdriver -v. This does
+ * not isolate the allocator as cleanly as hoped: on most traces the
+ * compiled replay is slower than mdriver, with the extra time spent inside
+ * the allocator calls (see the README).
+ *
+ *   make replay REPLAY_TRACES="traces/trace_*" && ./replay
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./fsecs.h"
+#include "./memlib.h"
+#include "./replay.h"
+
+int verbose = 0;  /* used by fsecs.c */
+
+/* One timed run */
+typedef struct {
+  const malloc_impl_t *impl;
+  const replay_trace_t *trace;
+} run_t;
+
+void replay_fail(const char *trace, long op) {
+  fprintf(stderr, "replay: allocation failed at op %ld of %s\n", op, trace);
+  exit(1);
+}
+
+/* Called by fsecs */
+static void run_once(void *p) {
+  run_t *run = p;
+  run->impl->reset_brk();
+  if (run->impl->init() < 0) {
+    fprintf(stderr, "replay: init failed\n");
+    exit(1);
+  }
+  for (int c = 0; c < run->trace->num_chunks; c++) {
+    run->trace->chunks[c]();
+  }
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: replay [-hml] [trace-prefix...]\n");
+  fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-m         Only run our allocator.\n");
+  fprintf(stderr, "\t-l         Only run libc malloc.\n");
+  fprintf(stderr, "\t-h         Print this message.\n");
+  fprintf(stderr, "Compiled traces\n");
+  for (int i = 0; my_replay_traces[i].name; i++) {
+    fprintf(stderr, "\t%s\n", my_replay_traces[i].name);
+  }
+}
+
+int main(int argc, char **argv) {
+  int run_my = 1, run_libc = 1;
+  int c;
+
+  while ((c = getopt(argc, argv, "mlh")) != EOF) {
+    switch (c) {
+      case 'm':
+        run_libc = 0;
+        break;
+      case 'l':
+        run_my = 0;
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  if (!run_my && !run_libc) {
+    fprintf(stderr, "replay: -m and -l exclude each other\n");
+    exit(1);
+  }
+
+  mem_init();
+  init_fsecs();
+
+  printf("%30s%10s%10s%10s%8s\n", "trace", "ops", "libc", "my", "my/libc");
+  for (int i = 0; my_replay_traces[i].name; i++) {
+    int selected = optind == argc;
+    for (int a = optind; a < argc; a++) {
+      selected |= !strncmp(my_replay_traces[i].name, argv[a],
+                           strlen(argv[a]));
+    }
+    if (!selected) continue;
+
+    double ops = my_replay_traces[i].num_ops;
+    double my_kops = 0, libc_kops = 0;
+    printf("%30s%10.0f", my_replay_traces[i].name, ops);
+    if (run_libc) {
+      run_t run = {&libc_impl, &libc_replay_traces[i]};
+      libc_kops = ops / fsecs(run_once, &run) / 1000;
+      printf("%10.0f", libc_kops);
+    } else {
+      printf("%10s", "-");
+    }
+    if (run_my) {
+      run_t run = {&my_impl, &my_replay_traces[i]};
+      my_kops = ops / fsecs(run_once, &run) / 1000;
+      printf("%10.0f", my_kops);
+    } else {
+      printf("%10s", "-");
+    }
+    if (run_my && run_libc) {
+      printf("%8.2f", my_kops / libc_kops);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+
+  mem_deinit();
+  return 0;
+}
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+/*
+ * replay.h - Interface between replay.c and the C that tools/trace2c.py
+ *            generates from traces
+ *
+ * The generated file is compiled once per allocator, with REPLAY_IMPL set
+ * to my or libc. Each compilation calls that allocator's functions directly
+ * and defines <impl>_replay_traces[], one entry per compiled trace.
+ */
+
+#ifndef MM_REPLAY_H
+#define MM_REPLAY_H
+
+#include <stdlib.h>
+
+#include "./allocator_interface.h"
+
+/* One trace, compiled into functions of a chunk of statements each. The
+ * arrays end with an entry whose name is NULL. */
+typedef struct {
+  const char *name;
+  long num_ops;
+  int num_chunks;
+  void (*const *chunks)(void);
+} replay_trace_t;
+
+/* One op of a run that the generated code replays in a loop */
+typedef struct {
+  int index;
+  int size;
+} replay_op_t;
+
+extern const replay_trace_t my_replay_traces[];
+extern const replay_trace_t libc_replay_traces[];
+
+/* Called by the generated code when an allocation fails */
+void replay_fail(const char *trace, long op);
+
+/* What mdriver does for a w op: read bytes, do some computation, write */
+static inline void replay_write(char *p, int size) {
+  for (int offset = 1; offset < size; offset++) {
+    ((volatile char *)p)[offset] = ((volatile char *)p)[offset - 1] ^ 0x7B;
+  }
+}
+
+#endif  // MM_REPLAY_H
@@ -0,0 +1,133 @@
+#!/usr/bin/env python
+#
+# amplify.py - build scaled variants of an existing trace.
+#
+# The transformations are applied in this order, and any subset may be used:
+#   --stretch F     time-stretch: every block's ops after its alloc are
+#                   pushed F times further out, so lifetimes grow by F and
+#                   the live set grows with them
+#   --scale F       multiply every alloc, realloc and write size by F
+#   --replicate K   K copies of the trace back to back, ids remapped
+#   --interleave K  K copies of the trace run concurrently, ops taken from
+#                   each copy in turn, ids remapped
+# The header (num_ids, num_ops) of the output always matches its ops.
+#
+# Big outputs need a bigger simulated heap; rebuild mdriver with e.g.
+#   make partial_clean mdriver PARAMS="-DMAX_HEAP=4294967296L"
+# A heap of a few GB works, but no single request may reach 2 GB (mem_sbrk
+# takes an int), and free blocks only coalesce up to 4 GB (32-bit sizes).
+#
+# Usage:
+#   tools/amplify.py --interleave 8 --scale 4 traces/trace_c4_v0 -o big_c4
+#   tools/amplify.py --stretch 3 traces/trace_c6_v0 > stretched_c6
+from __future__ import print_function, division
+
+import argparse
+import sys
+
+import tracefile as tr
+
+# Sizes are read as ints by mdriver and stored in 32 bits by the allocator.
+MAX_SIZE = (1 << 31) - 1
+
+
+def stretch(ops, factor):
+  """Stretch lifetimes by factor, keeping the order of every block's ops.
+  Every alloc gets a fresh id, so that a reused id cannot have its next
+  alloc land before its stretched free."""
+  born = {}   # old id -> (alloc op index, new id)
+  timed = []
+  next_id = 0
+  for i, (kind, index, size) in enumerate(ops):
+    if kind == tr.ALLOC:
+      born[index] = (i, next_id)
+      next_id += 1
+    start, new_id = born[index]
+    if kind == tr.FREE:
+      del born[index]
+    timed.append((start + factor * (i - start), i, (kind, new_id, size)))
+  # Ties keep the original order
+  timed.sort(key=lambda x: (x[0], x[1]))
+  return [op for _, _, op in timed]
+
+
+def scale(ops, factor):
+  scaled = []
+  for kind, index, size in ops:
+    if kind != tr.FREE:
+      size = max(1, int(size * factor))
+      if size > MAX_SIZE:
+        raise ValueError('scaled size %d does not fit in a trace' % size)
+    scaled.append((kind, index, size))
+  return scaled
+
+
+def remap(ops, copy, num_ids):
+  offset = copy * num_ids
+  return [(kind, index + offset, size) for kind, index, size in ops]
+
+
+def replicate(ops, copies, num_ids):
+  out = []
+  for c in range(copies):
+    out.extend(remap(ops, c, num_ids))
+  return out
+
+
+def interleave(ops, copies, num_ids):
+  streams = [remap(ops, c, num_ids) for c in range(copies)]
+  out = []
+  for i in range(len(ops)):
+    for stream in streams:
+      out.append(stream[i])
+  return out
+
+
+def amplify(trace, stretch_by=None, scale_by=None, copies=1,
+            interleaved=False):
+  ops = trace.ops
+  heap = trace.sugg_heapsize
+  if stretch_by:
+    ops = stretch(ops, stretch_by)
+  if scale_by:
+    ops = scale(ops, scale_by)
+    heap = int(heap * scale_by)
+  if copies > 1:
+    # Counted after stretch, which gives every alloc a new id
+    num_ids = tr.Trace(ops).num_ids
+    ops = (interleave if interleaved else replicate)(ops, copies, num_ids)
+    heap *= copies
+  return tr.Trace(ops, sugg_heapsize=min(heap, MAX_SIZE), weight=trace.weight)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Build a scaled variant of an mdriver trace.')
+  parser.add_argument('trace', help='input trace file')
+  parser.add_argument('--stretch', type=int, default=None,
+                      help='multiply block lifetimes (in ops) by F')
+  parser.add_argument('--scale', type=float, default=None,
+                      help='multiply request sizes by F')
+  copies = parser.add_mutually_exclusive_group()
+  copies.add_argument('--replicate', type=int, default=None,
+                      help='K copies back to back')
+  copies.add_argument('--interleave', type=int, default=None,
+                      help='K copies with their ops interleaved')
+  parser.add_argument('-o', '--output', default=None,
+                      help='output trace file (default: stdout)')
+  args = parser.parse_args()
+
+  trace = tr.read_trace(args.trace)
+  out = amplify(trace, args.stretch, args.scale,
+                args.replicate or args.interleave or 1,
+                args.interleave is not None)
+
+  if args.output:
+    with open(args.output, 'w') as f:
+      tr.write_trace(f, out)
+  else:
+    tr.write_trace(sys.stdout, out)
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,191 @@
+#!/usr/bin/env python
+#
+# analyze.py - characterize mdriver traces and emit the statistics as JSON.
+#
+# For each trace, reports:
+#   ops          counts of each op type
+#   sizes        power-of-two histogram of request sizes (alloc and realloc)
+#                and the most frequent exact sizes
+#   lifetimes    distribution of block lifetimes, in ops from alloc to free
+#   live         peak live bytes and peak live block count, plus a timeline
+#                of both sampled at evenly spaced ops
+#   realloc      realloc chain lengths per block and the growth factors
+#   ordering     how often a free releases the youngest live block (LIFO)
+#                or the oldest one (FIFO)
+#   writes       how much of the allocated data the w ops touch
+#
+# Usage:
+#   tools/analyze.py traces/ additional_traces/ > stats.json
+#   tools/analyze.py --top 5 --samples 20 traces/trace_c6_v0
+from __future__ import print_function, division
+
+import argparse
+import collections
+import heapq
+import json
+import sys
+
+import tracefile as tr
+
+
+def pow2_bucket(n):
+  """Smallest power of two >= n (0 for n == 0)."""
+  return 1 << (n - 1).bit_length() if n > 0 else 0
+
+
+def histogram(values):
+  """Power-of-two histogram, as a list of [bucket upper bound, count]."""
+  counts = collections.Counter(pow2_bucket(v) for v in values)
+  return [[bucket, counts[bucket]] for bucket in sorted(counts)]
+
+
+def percentiles(values):
+  if not values:
+    return {}
+  values = sorted(values)
+
+  def at(p):
+    return values[min(len(values) - 1, int(p * len(values)))]
+  return {
+    'min': values[0], 'p50': at(0.50), 'p90': at(0.90), 'p99': at(0.99),
+    'max': values[-1], 'mean': sum(values) / len(values),
+  }
+
+
+def analyze(trace, top, samples):
+  ops = trace.ops
+  counts = collections.Counter(kind for kind, _, _ in ops)
+
+  sizes = []
+  lifetimes = []
+  growth = []
+  chains = collections.Counter()  # id -> reallocs in the current chain
+  chain_lengths = []
+  born = {}        # id -> op index of its alloc
+  block_size = {}  # id -> current size
+  seq = {}         # id -> allocation sequence number
+  youngest = []    # max-heap of (-seq, id), lazily pruned
+  oldest = []      # min-heap of (seq, id), lazily pruned
+  lifo = fifo = 0
+  next_seq = 0
+  live_bytes = live_count = 0
+  peak_bytes = peak_count = 0
+  timeline = []
+  step = max(1, len(ops) // samples) if samples else 0
+  written_ids = set()
+  write_bytes = 0
+  write_fraction = []
+
+  for i, (kind, index, size) in enumerate(ops):
+    if kind == tr.ALLOC:
+      sizes.append(size)
+      born[index] = i
+      block_size[index] = size
+      seq[index] = next_seq
+      heapq.heappush(youngest, (-next_seq, index))
+      heapq.heappush(oldest, (next_seq, index))
+      next_seq += 1
+      chains[index] = 0
+      live_bytes += size
+      live_count += 1
+    elif kind == tr.REALLOC:
+      sizes.append(size)
+      old = block_size.get(index, 0)
+      if old:
+        growth.append(size / old)
+      block_size[index] = size
+      chains[index] += 1
+      live_bytes += size - old
+    elif kind == tr.FREE:
+      # Drop stale heap entries, then compare against the extremes
+      while youngest and seq.get(youngest[0][1]) != -youngest[0][0]:
+        heapq.heappop(youngest)
+      while oldest and seq.get(oldest[0][1]) != oldest[0][0]:
+        heapq.heappop(oldest)
+      if youngest and youngest[0][1] == index:
+        lifo += 1
+      if oldest and oldest[0][1] == index:
+        fifo += 1
+      if index in born:
+        lifetimes.append(i - born.pop(index))
+      chain_lengths.append(chains.pop(index, 0))
+      live_bytes -= block_size.pop(index, 0)
+      live_count -= 1
+      seq.pop(index, None)
+    elif kind == tr.WRITE:
+      written_ids.add(index)
+      write_bytes += size
+      if block_size.get(index):
+        write_fraction.append(size / block_size[index])
+
+    peak_bytes = max(peak_bytes, live_bytes)
+    peak_count = max(peak_count, live_count)
+    if step and (i % step == 0 or i == len(ops) - 1):
+      timeline.append([i, live_bytes, live_count])
+
+  # Blocks still live at the end of the trace
+  chain_lengths.extend(chains.values())
+  frees = counts[tr.FREE]
+
+  return {
+    'trace': trace.name,
+    'num_ids': trace.num_ids,
+    'num_ops': trace.num_ops,
+    'ops': {
+      'alloc': counts[tr.ALLOC], 'free': frees,
+      'realloc': counts[tr.REALLOC], 'write': counts[tr.WRITE],
+    },
+    'sizes': {
+      'histogram': histogram(sizes),
+      'top': [[size, n] for size, n in
+              collections.Counter(sizes).most_common(top)],
+      'stats': percentiles(sizes),
+    },
+    'lifetimes': {
+      'histogram': histogram(lifetimes),
+      'stats': percentiles(lifetimes),
+      'never_freed': len(born),
+    },
+    'live': {
+      'peak_bytes': peak_bytes,
+      'peak_count': peak_count,
+      'timeline': timeline,
+    },
+    'realloc': {
+      'chain_lengths': sorted(collections.Counter(chain_lengths).items()),
+      'growth': percentiles(growth),
+      'shrinks': sum(1 for g in growth if g < 1),
+    },
+    'ordering': {
+      'lifo': lifo / frees if frees else 0,
+      'fifo': fifo / frees if frees else 0,
+    },
+    'writes': {
+      'ids_written': len(written_ids) / trace.num_ids if trace.num_ids else 0,
+      'bytes_written': write_bytes,
+      'block_fraction': percentiles(write_fraction),
+    },
+  }
+
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Characterize mdriver traces as JSON.')
+  parser.add_argument('paths', nargs='+', help='trace files or directories')
+  parser.add_argument('--top', type=int, default=10,
+                      help='number of most frequent sizes (default %(default)s)')
+  parser.add_argument('--samples', type=int, default=100,
+                      help='points in the live timeline (default %(default)s)')
+  args = parser.parse_args()
+
+  stats = []
+  for path in tr.trace_files(args.paths):
+    trace = tr.read_trace(path)
+    trace.name = path
+    stats.append(analyze(trace, args.top, args.samples))
+  json.dump(stats, sys.stdout, indent=2, sort_keys=True)
+  print()
+
+
+if __name__ == '__main__':
+  main()
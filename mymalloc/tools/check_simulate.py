@@ -0,0 +1,95 @@
+#!/usr/bin/env python
+#
+# check_simulate.py - check that the metadata-only build (make SIMULATE=1)
+# computes the same utilization as the real allocator.
+#
+# Builds mdriver with SIMULATE=1 and then normally (so the normal build is
+# left in place), runs both over each trace directory, and compares the
+# utilization of every trace and the util score. Exits 1 on a mismatch.
+#
+# Usage (from mymalloc/):
+#   tools/check_simulate.py traces/ additional_traces/
+#   tools/check_simulate.py --params "-D SHRINK_MIN_SIZE=64" traces/
+from __future__ import print_function
+
+import argparse
+import os
+import subprocess
+import sys
+
+
+def build(params, simulate):
+  subprocess.check_call(['make', 'partial_clean', 'mdriver',
+                         'PARAMS=%s' % params,
+                         'SIMULATE=%d' % simulate],
+                        stdout=open(os.devnull, 'w'))
+
+
+def run(args):
+  return subprocess.check_output(['./mdriver'] + args,
+                                 universal_newlines=True).splitlines()
+
+
+def score(lines):
+  for line in lines:
+    if line.startswith('#') and '(util)' in line:
+      return line.split()[1]
+  raise RuntimeError('mdriver printed no util score')
+
+
+def simulated(trace_dir):
+  """Per-trace util (as printed, in %) and the util score of SIMULATE=1"""
+  lines = run(['-t', trace_dir])
+  utils = {}
+  for line in lines:
+    fields = line.split()
+    if len(fields) == 4 and fields[2].endswith('%'):
+      utils[fields[1]] = fields[2]
+  return utils, score(lines)
+
+
+def real(trace_dir):
+  """Per-trace util (as printed, in %) and the util score of mdriver -v"""
+  lines = run(['-v', '-t', trace_dir])
+  utils = {}
+  in_table = False
+  for line in lines:
+    fields = line.split()
+    if line.startswith('(throughput)'):
+      in_table = True
+    elif in_table and len(fields) == 6:
+      utils[fields[0]] = fields[5]
+  return utils, score(lines)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Compare the SIMULATE=1 build with the real allocator.')
+  parser.add_argument('dirs', nargs='+', help='trace directories')
+  parser.add_argument('--params', default='',
+                      help='PARAMS for both builds')
+  args = parser.parse_args()
+
+  build(args.params, 1)
+  sim = [simulated(d) for d in args.dirs]
+  build(args.params, 0)
+  ok = True
+  for trace_dir, (sim_utils, sim_score) in zip(args.dirs, sim):
+    utils, util_score = real(trace_dir)
+    for name in sorted(utils):
+      if sim_utils.get(name) != utils[name]:
+        print('%s: util %s, simulated %s' %
+              (name, utils[name], sim_utils.get(name)))
+        ok = False
+    if sim_score != util_score:
+      print('%s: util score %s, simulated %s' %
+            (trace_dir, util_score, sim_score))
+      ok = False
+    else:
+      print('%s: %d traces, util score %s in both builds' %
+            (trace_dir, len(utils), util_score))
+  sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+#
+# convert.py - turn binary logs written by librecorder.so into mdriver
+# traces.
+#
+# The records (record_t in recorder.h) are put back in global order, block
+# ids are renumbered densely, and ops on blocks allocated before recording
+# started are dropped. malloc(0) is recorded as a 1-byte alloc, since mdriver
+# requires sizes > 0. Blocks still live at exit are left live. --thread
+# restricts the trace to the ops of one thread id.
+#
+# The trace uses the extended grammar (see tracefile.py): calloc becomes a c
+# op, the memalign family m ops, and every op is annotated with its thread
+# id and, if sites were recorded, a call-site id (sites are numbered densely
+# from 1 in order of first use). --plain writes classic a/f/r ops only.
+#
+# Usage:
+#   tools/convert.py app.bin > trace_app
+#   tools/convert.py --thread 1234 app.bin -o trace_app_1234
+from __future__ import print_function, division
+
+import argparse
+import collections
+import struct
+import sys
+
+import tracefile as tr
+
+# Must match record_t in recorder.h
+RECORD = struct.Struct('=QQQQQIB3x')
+
+
+def read_records(path):
+  with open(path, 'rb') as f:
+    data = f.read()
+  usable = len(data) - len(data) % RECORD.size
+  records = [RECORD.unpack_from(data, off)
+             for off in range(0, usable, RECORD.size)]
+  records.sort()
+  return records
+
+
+def convert(records, thread=None, plain=False):
+  ids = {}
+  sites = {}
+  ops = []
+  info = []
+  stats = collections.Counter()
+  for seq, block, size, align, site, tid, kind in records:
+    kind = chr(kind)
+    stats[kind] += 1
+    if thread is not None and tid != thread:
+      continue
+    extra = {'t': tid}
+    if site:
+      extra['s'] = sites.setdefault(site, len(sites) + 1)
+    if kind in ('a', 'c', 'm'):
+      ids[block] = len(ids)
+      if plain or kind == 'a':
+        ops.append((tr.ALLOC, ids[block], max(1, size)))
+      elif kind == 'c':
+        ops.append((tr.CALLOC, ids[block], max(1, size)))
+      else:
+        ops.append((tr.MEMALIGN, ids[block], max(1, size)))
+        extra['align'] = align
+    elif block not in ids:
+      stats['dropped'] += 1
+      continue
+    elif kind == 'r':
+      ops.append((tr.REALLOC, ids[block], max(1, size)))
+    elif kind == 'f':
+      ops.append((tr.FREE, ids[block], 0))
+    else:
+      continue
+    info.append(extra)
+  return tr.Trace(ops, info=None if plain else info), stats
+
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Convert librecorder.so logs to mdriver traces.')
+  parser.add_argument('log', help='binary log written by librecorder.so')
+  parser.add_argument('--thread', type=int, default=None,
+                      help='only keep the ops of this thread id')
+  parser.add_argument('--plain', action='store_true',
+                      help='classic a/f/r ops only, without annotations')
+  parser.add_argument('-o', '--output', default=None,
+                      help='output trace file (default: stdout)')
+  args = parser.parse_args()
+
+  trace, stats = convert(read_records(args.log), args.thread,
+                         args.plain)
+  if args.output:
+    with open(args.output, 'w') as f:
+      tr.write_trace(f, trace)
+  else:
+    tr.write_trace(sys.stdout, trace)
+  sys.stderr.write('%d ops (%s)\n' % (trace.num_ops, ', '.join(
+    '%s: %d' % kv for kv in sorted(stats.items()))))
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,224 @@
+#!/usr/bin/env python
+#
+# generate.py - seeded, deterministic synthetic trace generator.
+#
+# Traces are driven by a JSON config made of phases. Every step of a phase
+# allocates one block, whose size and lifetime (in steps) are drawn from the
+# phase's distributions; blocks are freed when their lifetime is up, or
+# earlier if the phase's peak_live_bytes would otherwise be exceeded. Steps
+# may also realloc a random live block by a growth factor, and write to one.
+# Blocks outlive the phase they were allocated in, so phase changes leave
+# the old phase's blocks scattered through the heap.
+#
+# Config format (see tools/configs/ for examples):
+#   {
+#     "seed": 1,
+#     "free_at_end": true,
+#     "phases": [
+#       {
+#         "steps": 10000,
+#         "sizes": {"dist": "lognormal", "mu": 5.0, "sigma": 1.0,
+#                   "min": 1, "max": 65536},
+#         "lifetime": {"dist": "exponential", "mean": 500},
+#         "realloc": {"prob": 0.05,
+#                     "growth": {"dist": "choice", "values": [1.5, 2.0]}},
+#         "write": {"prob": 0.3, "fraction": 1.0},
+#         "peak_live_bytes": 1000000
+#       }
+#     ]
+#   }
+#
+# Distributions are {"dist": "constant", "value": v},
+# {"dist": "uniform", "min": a, "max": b}, {"dist": "exponential",
+# "mean": m}, {"dist": "lognormal", "mu": mu, "sigma": s}, or
+# {"dist": "choice", "values": [...], "weights": [...]}; any of them may
+# carry "min" and "max" clamps. A lifetime of null means never freed.
+#
+# The generator uses its own PRNG, so a config and seed produce the same
+# trace under any Python version.
+#
+# Usage:
+#   tools/generate.py tools/configs/phase_shift.json -o trace_phase_shift
+#   tools/generate.py --seed 7 tools/configs/phase_shift.json > trace
+from __future__ import print_function, division
+
+import argparse
+import heapq
+import json
+import math
+import sys
+
+import tracefile as tr
+
+
+class Rng(object):
+  """splitmix64, so that traces do not depend on the Python version."""
+
+  MASK = (1 << 64) - 1
+
+  def __init__(self, seed):
+    self.state = seed & self.MASK
+
+  def next(self):
+    self.state = (self.state + 0x9E3779B97F4A7C15) & self.MASK
+    z = self.state
+    z = ((z ^ (z >> 30)) * 0xBF58476D1CE4E5B9) & self.MASK
+    z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & self.MASK
+    return z ^ (z >> 31)
+
+  def random(self):
+    """Uniform float in [0, 1)."""
+    return (self.next() >> 11) / float(1 << 53)
+
+  def below(self, n):
+    """Uniform integer in [0, n)."""
+    return self.next() % n
+
+
+def sample(rng, dist):
+  """Draw one value from a distribution config."""
+  kind = dist.get('dist', 'constant')
+  if kind == 'constant':
+    value = dist['value']
+  elif kind == 'uniform':
+    value = dist['min'] + rng.random() * (dist['max'] - dist['min'])
+  elif kind == 'exponential':
+    value = -math.log(1.0 - rng.random()) * dist['mean']
+  elif kind == 'lognormal':
+    # Box-Muller
+    u1 = 1.0 - rng.random()
+    u2 = rng.random()
+    normal = math.sqrt(-2.0 * math.log(u1)) * math.cos(2.0 * math.pi * u2)
+    value = math.exp(dist['mu'] + dist['sigma'] * normal)
+  elif kind == 'choice':
+    values = dist['values']
+    weights = dist.get('weights', [1] * len(values))
+    x = rng.random() * sum(weights)
+    value = values[-1]
+    for v, w in zip(values, weights):
+      if x < w:
+        value = v
+        break
+      x -= w
+  else:
+    raise ValueError('unknown distribution: %s' % kind)
+  if 'min' in dist:
+    value = max(value, dist['min'])
+  if 'max' in dist:
+    value = min(value, dist['max'])
+  return value
+
+
+class Generator(object):
+  def __init__(self, config, seed):
+    self.config = config
+    self.rng = Rng(seed)
+    self.ops = []
+    self.now = 0
+    self.next_id = 0
+    self.sizes = {}     # live id -> size
+    self.live = []      # live ids, for picking one at random
+    self.slot = {}      # live id -> position in self.live
+    self.deaths = []    # min-heap of (death step, id)
+    self.live_bytes = 0
+    self.peak_bytes = 0
+
+  def alloc(self, size, death):
+    index = self.next_id
+    self.next_id += 1
+    self.ops.append((tr.ALLOC, index, size))
+    self.sizes[index] = size
+    self.slot[index] = len(self.live)
+    self.live.append(index)
+    if death is not None:
+      heapq.heappush(self.deaths, (death, index))
+    self.live_bytes += size
+    self.peak_bytes = max(self.peak_bytes, self.live_bytes)
+
+  def free(self, index):
+    self.ops.append((tr.FREE, index, 0))
+    self.live_bytes -= self.sizes.pop(index)
+    # Swap-remove from the live list
+    pos = self.slot.pop(index)
+    last = self.live.pop()
+    if last != index:
+      self.live[pos] = last
+      self.slot[last] = pos
+
+  def free_due(self, now, need=0, cap=None):
+    """Free the blocks whose lifetime is up, then keep freeing the ones that
+    die soonest until need more bytes fit under cap."""
+    while self.deaths:
+      death, index = self.deaths[0]
+      if index not in self.sizes:
+        heapq.heappop(self.deaths)
+      elif death <= now or (cap is not None and
+                             self.live_bytes + need > cap):
+        heapq.heappop(self.deaths)
+        self.free(index)
+      else:
+        break
+
+  def step(self, phase):
+    self.now += 1
+    cap = phase.get('peak_live_bytes')
+    size = max(1, int(sample(self.rng, phase['sizes'])))
+    self.free_due(self.now, size, cap)
+
+    lifetime = phase.get('lifetime')
+    death = None
+    if lifetime is not None:
+      death = self.now + max(1, int(round(sample(self.rng, lifetime))))
+    self.alloc(size, death)
+
+    realloc = phase.get('realloc')
+    if realloc and self.live and self.rng.random() < realloc['prob']:
+      index = self.live[self.rng.below(len(self.live))]
+      old = self.sizes[index]
+      new = max(1, int(old * sample(self.rng, realloc['growth'])))
+      if cap is None or self.live_bytes + new - old <= cap:
+        self.ops.append((tr.REALLOC, index, new))
+        self.sizes[index] = new
+        self.live_bytes += new - old
+        self.peak_bytes = max(self.peak_bytes, self.live_bytes)
+
+    write = phase.get('write')
+    if write and self.live and self.rng.random() < write['prob']:
+      index = self.live[self.rng.below(len(self.live))]
+      size = max(1, int(self.sizes[index] * write.get('fraction', 1.0)))
+      self.ops.append((tr.WRITE, index, min(size, self.sizes[index])))
+
+  def run(self):
+    for phase in self.config['phases']:
+      for _ in range(phase['steps']):
+        self.step(phase)
+    if self.config.get('free_at_end', True):
+      for index in sorted(self.sizes):
+        self.free(index)
+    return tr.Trace(self.ops, sugg_heapsize=self.peak_bytes)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Generate a synthetic mdriver trace from a JSON config.')
+  parser.add_argument('config', help='JSON config file')
+  parser.add_argument('--seed', type=int, default=None,
+                      help='override the seed in the config')
+  parser.add_argument('-o', '--output', default=None,
+                      help='output trace file (default: stdout)')
+  args = parser.parse_args()
+
+  with open(args.config) as f:
+    config = json.load(f)
+  seed = args.seed if args.seed is not None else config.get('seed', 1)
+  trace = Generator(config, seed).run()
+
+  if args.output:
+    with open(args.output, 'w') as f:
+      tr.write_trace(f, trace)
+  else:
+    tr.write_trace(sys.stdout, trace)
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,193 @@
+#!/usr/bin/env python
+#
+# minimize.py - cut traces down to cheap proxies for tuning.
+#
+#   reduce    Sample op windows, one from each of evenly spaced strata of
+#             each trace. Before each window the reduced trace's live set is
+#             reconstructed to match the full trace's at that point: blocks
+#             that died since the previous window are freed, reallocs are
+#             applied, and blocks born in between are allocated. Ops between
+#             windows are otherwise dropped; ids are remapped.
+#
+#   validate  Build mdriver for each allocator configuration (a PARAMS
+#             string, as used by OpenTuner), score the full and the reduced
+#             trace sets with mdriver -g, and report the Spearman rank
+#             correlation of the perfidx values. A proxy is only useful if
+#             it ranks configurations like the full traces do.
+#
+# Usage (from mymalloc/):
+#   tools/minimize.py reduce traces/ -o reduced_traces/ --windows 4 --ops 1000
+#   tools/minimize.py validate traces/ reduced_traces/ \
+#       --config "" --config "-D SHRINK_MIN_SIZE=64" \
+#       --config "-D SHRINK_MIN_SIZE=256" --config "-D MIN_BLOCK_POW=5"
+from __future__ import print_function, division
+
+import argparse
+import os
+import subprocess
+import sys
+
+import tracefile as tr
+from generate import Rng
+
+
+def reduce_trace(trace, windows, window_ops, seed):
+  ops = trace.ops
+  n = len(ops)
+  rng = Rng(seed)
+  if windows * window_ops >= n:
+    return tr.Trace(list(ops), trace.sugg_heapsize, trace.weight)
+
+  # One window at a random offset inside each of `windows` equal strata
+  stratum = n // windows
+  starts = [k * stratum + rng.below(max(1, stratum - window_ops))
+            for k in range(windows)]
+
+  out = []
+  next_id = 0
+  emitted = {}    # id in the full trace -> (id, size) in the reduced trace
+  live = {}       # id -> (alloc sequence number, size)
+  seq = 0
+  w = 0
+  for i, (kind, index, size) in enumerate(ops):
+    if w < len(starts) and i == starts[w]:
+      # Catch the reduced trace's live set up with the full trace's: free
+      # what died since the last window, resize what was realloced, and
+      # allocate what was born, in allocation order
+      for old in sorted(emitted, key=lambda x: emitted[x][0]):
+        if old not in live:
+          out.append((tr.FREE, emitted.pop(old)[0], 0))
+      for old in sorted(live, key=lambda x: live[x][0]):
+        if old not in emitted:
+          emitted[old] = (next_id, live[old][1])
+          out.append((tr.ALLOC, next_id, live[old][1]))
+          next_id += 1
+        elif emitted[old][1] != live[old][1]:
+          emitted[old] = (emitted[old][0], live[old][1])
+          out.append((tr.REALLOC, emitted[old][0], live[old][1]))
+      w += 1
+      end = i + window_ops
+
+    in_window = w > 0 and i < end
+    if in_window and kind == tr.ALLOC:
+      emitted[index] = (next_id, size)
+      next_id += 1
+    if in_window:
+      out.append((kind, emitted[index][0], size))
+      if kind == tr.REALLOC:
+        emitted[index] = (emitted[index][0], size)
+      elif kind == tr.FREE:
+        del emitted[index]
+
+    # Track the live set of the full trace
+    if kind == tr.ALLOC:
+      live[index] = (seq, size)
+      seq += 1
+    elif kind == tr.REALLOC:
+      live[index] = (live[index][0], size)
+    elif kind == tr.FREE:
+      live.pop(index, None)
+
+  for new, _ in sorted(emitted.values()):
+    out.append((tr.FREE, new, 0))
+  return tr.Trace(out, trace.sugg_heapsize, trace.weight)
+
+
+def spearman(xs, ys):
+  """Spearman rank correlation, with average ranks for ties."""
+  def ranks(values):
+    order = sorted(range(len(values)), key=lambda i: values[i])
+    r = [0.0] * len(values)
+    i = 0
+    while i < len(order):
+      j = i
+      while j + 1 < len(order) and values[order[j + 1]] == values[order[i]]:
+        j += 1
+      for k in range(i, j + 1):
+        r[order[k]] = (i + j) / 2.0
+      i = j + 1
+    return r
+
+  rx, ry = ranks(xs), ranks(ys)
+  n = len(xs)
+  mx, my = sum(rx) / n, sum(ry) / n
+  cov = sum((a - mx) * (b - my) for a, b in zip(rx, ry))
+  vx = sum((a - mx) ** 2 for a in rx)
+  vy = sum((b - my) ** 2 for b in ry)
+  if vx == 0 or vy == 0:
+    return float('nan')
+  return cov / (vx * vy) ** 0.5
+
+
+def perfidx(trace_dir):
+  out = subprocess.check_output(['./mdriver', '-g', '-t', trace_dir],
+                                universal_newlines=True)
+  for line in out.splitlines():
+    if line.startswith('perfidx:'):
+      return float(line.split(':', 1)[1])
+  raise RuntimeError('mdriver printed no perfidx for %s' % trace_dir)
+
+
+def build(params):
+  subprocess.check_call(['make', 'partial_clean', 'mdriver',
+                         'PARAMS=%s' % params],
+                        stdout=open(os.devnull, 'w'))
+
+
+def do_reduce(args):
+  if not os.path.isdir(args.output):
+    os.makedirs(args.output)
+  for path in tr.trace_files(args.paths):
+    trace = tr.read_trace(path)
+    reduced = reduce_trace(trace, args.windows, args.ops, args.seed)
+    out = os.path.join(args.output, os.path.basename(path))
+    with open(out, 'w') as f:
+      tr.write_trace(f, reduced)
+    print('%30s%10d ->%8d ops' % (os.path.basename(path), trace.num_ops,
+                                   reduced.num_ops))
+
+
+def do_validate(args):
+  full, reduced = [], []
+  try:
+    for params in args.config:
+      build(params)
+      full.append(perfidx(args.full))
+      reduced.append(perfidx(args.reduced))
+      print('%-40s full %8.3f  reduced %8.3f' % (params or '(defaults)',
+                                                 full[-1], reduced[-1]))
+      sys.stdout.flush()
+  finally:
+    build('')
+  print('spearman rank correlation: %.3f' % spearman(full, reduced))
+
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Reduce traces to cheap tuning proxies and validate them.')
+  sub = parser.add_subparsers(dest='command')
+
+  p = sub.add_parser('reduce', help='write reduced traces')
+  p.add_argument('paths', nargs='+', help='trace files or directories')
+  p.add_argument('-o', '--output', required=True, help='output directory')
+  p.add_argument('--windows', type=int, default=4,
+                 help='op windows per trace (default %(default)s)')
+  p.add_argument('--ops', type=int, default=1000,
+                 help='ops per window (default %(default)s)')
+  p.add_argument('--seed', type=int, default=1)
+  p.set_defaults(func=do_reduce)
+
+  p = sub.add_parser('validate',
+                     help='rank-correlate full and reduced trace sets')
+  p.add_argument('full', help='full trace directory')
+  p.add_argument('reduced', help='reduced trace directory')
+  p.add_argument('--config', action='append', required=True,
+                 help='PARAMS for one allocator configuration (repeat)')
+  p.set_defaults(func=do_validate)
+
+  args = parser.parse_args()
+  args.func(args)
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,314 @@
+#!/usr/bin/env python
+#
+# oracle.py - offline utilization bounds for mdriver traces.
+#
+# For each trace, reports:
+#   peak_live    the peak of live payload bytes (mdriver's max total size)
+#   lower_bound  the peak of live bytes plus the minimum per-block metadata,
+#                i.e. the peak of sum(align(size + header)). No allocator
+#                that keeps a header in the heap can do better.
+#   oracle_heap  the heap size reached by a clairvoyant best-fit placement
+#                that knows when every block will be freed. This is a
+#                practical target rather than a bound.
+# and the utilization mdriver would score for each of them. With --mdriver,
+# the allocator's current utilization is measured as well, so the report
+# shows how much headroom is left on each trace.
+#
+# Usage:
+#   tools/oracle.py traces/ additional_traces/
+#   tools/oracle.py --mdriver ./mdriver --json traces/trace_c3_v0
+#   tools/oracle.py --check
+from __future__ import print_function, division
+
+import argparse
+import bisect
+import json
+import os
+import subprocess
+import sys
+
+import tracefile as tr
+
+NEVER = float('inf')
+
+
+def death_times(trace):
+  """For every alloc op, the index of the op that frees the block (or NEVER)."""
+  death = {}
+  pending = {}
+  for i, (kind, index, _) in enumerate(trace.ops):
+    if kind == tr.ALLOC:
+      pending[index] = i
+    elif kind == tr.FREE and index in pending:
+      death[pending.pop(index)] = i
+  for i in pending.values():
+    death[i] = NEVER
+  return death
+
+
+def peaks(trace, header):
+  """Peak live payload bytes, and peak of live footprints with metadata."""
+  sizes = {}
+  live = peak_live = 0
+  footprint = peak_footprint = 0
+  for kind, index, size in trace.ops:
+    if kind in (tr.ALLOC, tr.REALLOC):
+      old = sizes.get(index, 0)
+      live += size - old
+      if old:
+        footprint -= tr.align(old + header)
+      footprint += tr.align(size + header)
+      sizes[index] = size
+    elif kind == tr.FREE:
+      old = sizes.pop(index, 0)
+      live -= old
+      footprint -= tr.align(old + header)
+    peak_live = max(peak_live, live)
+    peak_footprint = max(peak_footprint, footprint)
+  return peak_live, peak_footprint
+
+
+class Oracle(object):
+  """Clairvoyant best-fit placement over an address-ordered list of gaps.
+
+  Among the gaps a block fits in, the one with the least leftover space is
+  chosen. Ties go to the gap next to the block whose death time is closest
+  to the new block's, and the block is placed against that neighbour, so
+  blocks that die together end up adjacent and their space coalesces.
+  """
+
+  def __init__(self):
+    self.brk = 0
+    self.starts = []      # sorted gap start addresses
+    self.gaps = {}        # gap start -> length
+    self.blocks = {}      # id -> (start, length)
+    self.death = {}       # id -> death time of the block
+    self.by_start = {}    # block start -> id
+    self.by_end = {}      # block end -> id
+
+  def _add_gap(self, start, length):
+    # Coalesce with the gaps on either side
+    end = start + length
+    if end in self.gaps:
+      length += self.gaps.pop(end)
+      self.starts.pop(bisect.bisect_left(self.starts, end))
+    i = bisect.bisect_left(self.starts, start)
+    if i > 0:
+      prev = self.starts[i - 1]
+      if prev + self.gaps[prev] == start:
+        self.gaps[prev] += length
+        return
+    self.starts.insert(i, start)
+    self.gaps[start] = length
+
+  def _take_gap(self, start):
+    self.starts.pop(bisect.bisect_left(self.starts, start))
+    return self.gaps.pop(start)
+
+  def _place(self, index, start, length, death):
+    self.blocks[index] = (start, length)
+    self.death[index] = death
+    self.by_start[start] = index
+    self.by_end[start + length] = index
+
+  def _unplace(self, index):
+    start, length = self.blocks.pop(index)
+    del self.by_start[start]
+    del self.by_end[start + length]
+    return start, length
+
+  def _distance(self, neighbour, death):
+    if neighbour is None:
+      return NEVER
+    other = self.death[neighbour]
+    if other == NEVER and death == NEVER:
+      return 0
+    return abs(other - death)
+
+  def alloc(self, index, length, death):
+    best = None
+    for start in self.starts:
+      gap = self.gaps[start]
+      if gap < length:
+        continue
+      low = self._distance(self.by_end.get(start), death)
+      high = self._distance(self.by_start.get(start + gap), death)
+      key = (gap - length, min(low, high))
+      if best is None or key < best[0]:
+        best = (key, start, low <= high)
+        if key == (0, 0):
+          break
+
+    if best is not None:
+      _, start, at_low = best
+      gap = self._take_gap(start)
+      if at_low:
+        if gap > length:
+          self._add_gap(start + length, gap - length)
+      else:
+        if gap > length:
+          self._add_gap(start, gap - length)
+        start += gap - length
+    else:
+      # Extend the heap, reusing the free gap at its top if there is one
+      start = self.brk
+      if self.starts:
+        top = self.starts[-1]
+        if top + self.gaps[top] == self.brk:
+          self._take_gap(top)
+          start = top
+      self.brk = start + length
+    self._place(index, start, length, death)
+
+  def free(self, index):
+    start, length = self._unplace(index)
+    self._add_gap(start, length)
+
+  def realloc(self, index, length):
+    start, old = self.blocks[index]
+    death = self.death[index]
+    end = start + old
+    if length <= old:
+      self._unplace(index)
+      self._place(index, start, length, death)
+      if length < old:
+        self._add_gap(start + length, old - length)
+      return
+
+    room = self.gaps.get(end, 0)
+    if end == self.brk or end + room == self.brk:
+      # Grow in place at the top of the heap, giving back the rest of the
+      # top gap if it is more than the block needs
+      if room:
+        self._take_gap(end)
+      self._unplace(index)
+      self._place(index, start, length, death)
+      if start + length < self.brk:
+        self._add_gap(start + length, self.brk - start - length)
+      self.brk = max(self.brk, start + length)
+    elif room >= length - old:
+      # Grow in place into the next gap
+      self._take_gap(end)
+      self._unplace(index)
+      self._place(index, start, length, death)
+      if room > length - old:
+        self._add_gap(start + length, room - (length - old))
+    else:
+      # Move: the old copy stays live until the new one is placed
+      self._unplace(index)
+      self.alloc(index, length, death)
+      self._add_gap(start, old)
+
+
+def oracle_heap(trace, header):
+  """Heap size reached by the clairvoyant best-fit placement."""
+  death = death_times(trace)
+  oracle = Oracle()
+  for i, (kind, index, size) in enumerate(trace.ops):
+    if kind == tr.ALLOC:
+      oracle.alloc(index, tr.align(size + header), death[i])
+    elif kind == tr.REALLOC:
+      oracle.realloc(index, tr.align(size + header))
+    elif kind == tr.FREE:
+      oracle.free(index)
+  return oracle.brk
+
+
+def util(peak_live, heap_size):
+  """Utilization as computed by eval_mm_util in mdriver.c."""
+  return (max(peak_live, tr.MEM_ALLOWANCE) /
+          max(heap_size, tr.MEM_ALLOWANCE))
+
+
+def check():
+  """Regression checks of the placement; returns a list of failures."""
+  failures = []
+  # Growing into part of the top gap must leave the rest of it free
+  oracle = Oracle()
+  oracle.alloc(0, 200, NEVER)
+  oracle.alloc(1, 100, NEVER)
+  oracle.free(1)
+  oracle.realloc(0, 210)
+  oracle.alloc(2, 80, NEVER)
+  if oracle.blocks[2] != (210, 80) or oracle.brk != 300:
+    failures.append('realloc into part of the top gap: block 2 at %d, brk %d'
+                    ' (want 210, 300)' % (oracle.blocks[2][0], oracle.brk))
+  return failures
+
+
+def current_util(mdriver, path):
+  """Run mdriver -v on one trace and return the utilization it reports."""
+  out = subprocess.check_output([mdriver, '-v', '-f', path],
+                                universal_newlines=True)
+  found = None
+  for line in out.splitlines():
+    fields = line.split()
+    if path in fields and fields[-1].endswith('%'):
+      # The final (throughput) table ends in the util column
+      found = float(fields[-1][:-1]) / 100
+    elif len(fields) == 4 and fields[1] == path and fields[2].endswith('%'):
+      # Metadata-only build: trace, filename, util, heapsize
+      found = float(fields[2][:-1]) / 100
+  return found
+
+
+def analyze(path, header, mdriver=None):
+  trace = tr.read_trace(path)
+  peak_live, lower_bound = peaks(trace, header)
+  heap = oracle_heap(trace, header)
+  report = {
+    'trace': path,
+    'peak_live': peak_live,
+    'lower_bound': lower_bound,
+    'oracle_heap': heap,
+    'util_bound': util(peak_live, lower_bound),
+    'util_oracle': util(peak_live, heap),
+  }
+  if mdriver:
+    report['util_current'] = current_util(mdriver, path)
+  return report
+
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Offline utilization bounds for mdriver traces.')
+  parser.add_argument('paths', nargs='*', help='trace files or directories')
+  parser.add_argument('--header', type=int, default=tr.HEADER_SIZE,
+                      help='per-block metadata bytes (default %(default)s)')
+  parser.add_argument('--mdriver', default=None,
+                      help='mdriver binary to measure current utilization')
+  parser.add_argument('--json', action='store_true', help='emit JSON')
+  parser.add_argument('--check', action='store_true',
+                      help='run the regression checks of the placement')
+  args = parser.parse_args()
+
+  if args.check:
+    failures = check()
+    for failure in failures:
+      print('FAIL: ' + failure)
+    if not failures:
+      print('oracle checks passed')
+    sys.exit(1 if failures else 0)
+  if not args.paths:
+    parser.error('no traces given')
+
+  reports = [analyze(path, args.header, args.mdriver)
+             for path in tr.trace_files(args.paths)]
+
+  if args.json:
+    json.dump(reports, sys.stdout, indent=2)
+    print()
+    return
+
+  print('%30s%12s%12s%12s%8s%8s%9s' % ('trace', 'peak_live', 'lower_bound',
+        'oracle_heap', 'bound', 'oracle', 'current'))
+  for r in reports:
+    current = r.get('util_current')
+    print('%30s%12d%12d%12d%7.0f%%%7.0f%%%8s' % (
+      os.path.basename(r['trace']), r['peak_live'], r['lower_bound'],
+      r['oracle_heap'], r['util_bound'] * 100, r['util_oracle'] * 100,
+      '%.0f%%' % (current * 100) if current is not None else '-'))
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,189 @@
+#!/usr/bin/env python
+#
+# trace2c.py - compile traces into C for the replay benchmark.
+#
+# Every op becomes one statement that calls the allocator directly, e.g.
+#   CHECK(b[3] = MALLOC(24), 17); FREE(b[3]); WRITE(b[5], 100);
+# except that runs of a repeated pattern of op kinds (up to --period kinds
+# long, covering at least --min-run ops) become a loop over a table of their
+# blocks and sizes. Straight-line code for a whole trace is far bigger than
+# the instruction cache, and the loops make it several times smaller and
+# quicker to compile. The statements are split into functions of about
+# --chunk each, so the compiler copes with long traces. The output is
+# compiled once per allocator, with REPLAY_IMPL=my or libc (see replay.h and
+# the replay target in the Makefile). Any trace mdriver reads can be
+# compiled, including the extended ops (c, m, F); annotations are ignored.
+#
+# Even so, compiled traces are not faster than mdriver's interpreter on
+# every trace: see the replay entry in the README for measurements.
+#
+# Usage:
+#   tools/trace2c.py traces/ -o replay_traces.c
+#   tools/trace2c.py --chunk 500 traces/trace_c0_v0 traces/trace_c1_v0 -o r.c
+from __future__ import print_function, division
+
+import argparse
+import re
+import sys
+
+import tracefile as tr
+
+HEADER = '''\
+/* Generated by tools/trace2c.py - do not edit. Compile with
+ * -DREPLAY_IMPL=my or -DREPLAY_IMPL=libc. */
+
+#include "./replay.h"
+
+#define CAT_(a, b) a##_##b
+#define CAT(a, b) CAT_(a, b)
+
+#define MALLOC(size) CAT(REPLAY_IMPL, malloc)(size)
+#define CALLOC(size) CAT(REPLAY_IMPL, calloc)(1, size)
+#define MEMALIGN(align, size) CAT(REPLAY_IMPL, memalign)(align, size)
+#define REALLOC(p, size) CAT(REPLAY_IMPL, realloc)(p, size)
+#define FREE(p) CAT(REPLAY_IMPL, free)(p)
+#define FREE_SIZED(p, size) CAT(REPLAY_IMPL, free_sized)(p, size)
+#define WRITE(p, size) replay_write(p, size)
+#define CHECK(call, op) \\
+  if (__builtin_expect(!(call), 0)) replay_fail(trace_name, op)
+
+'''
+
+
+def c_name(name):
+  return re.sub(r'\W', '_', name)
+
+
+def statement(kind, b, size, op, align=None):
+  """C for one op on block b of size bytes (op is the op's number, for
+  errors); b, size and op are C expressions."""
+  if kind == tr.ALLOC:
+    return 'CHECK(%s = MALLOC(%s), %s);' % (b, size, op)
+  if kind == tr.CALLOC:
+    return 'CHECK(%s = CALLOC(%s), %s);' % (b, size, op)
+  if kind == tr.MEMALIGN:
+    return 'CHECK(%s = MEMALIGN(%d, %s), %s);' % (b, align, size, op)
+  if kind == tr.REALLOC:
+    return 'CHECK(%s = REALLOC(%s, %s), %s);' % (b, b, size, op)
+  if kind == tr.FREE:
+    return 'FREE(%s);' % b
+  if kind == tr.FREE_SIZED:
+    return 'FREE_SIZED(%s, %s);' % (b, size)
+  if kind == tr.WRITE:
+    return 'WRITE(%s, %s);' % (b, size)
+  raise ValueError('unknown op %s' % kind)
+
+
+def segments(trace, max_period, min_ops):
+  """Split the ops into runs of a repeated pattern of op kinds, as
+  (start, period, repeats), each covering at least min_ops ops, and single
+  ops between them, as (start, 1, 1). memalign ops are never in a run, as
+  their alignment is not in the run's table."""
+  kinds = [op[0] for op in trace.ops]
+  n = len(kinds)
+  out = []
+  i = 0
+  while i < n:
+    best_period, best_repeats = 1, 1
+    for period in range(1, max_period + 1):
+      pattern = kinds[i:i + period]
+      if len(pattern) < period or tr.MEMALIGN in pattern:
+        break
+      repeats = 1
+      while kinds[i + repeats * period:i + (repeats + 1) * period] == pattern:
+        repeats += 1
+      if (repeats > 1 and repeats * period >= min_ops and
+          repeats * period > best_repeats * best_period):
+        best_period, best_repeats = period, repeats
+    out.append((i, best_period, best_repeats))
+    i += best_period * best_repeats
+  return out
+
+
+def compile_segment(out, trace, name, start, period, repeats):
+  """Write the C for one segment. A run is a loop over a table of the
+  (index, size) of its ops, so its code is reused on every iteration rather
+  than streamed through the instruction cache."""
+  if repeats == 1:
+    kind, index, size = trace.ops[start]
+    if kind == tr.WRITE and size <= 1:
+      return
+    align = trace.info[start]['align'] if kind == tr.MEMALIGN else None
+    out.write('  %s\n' % statement(kind, 'b[%d]' % index, '%d' % size,
+                                    '%d' % start, align))
+    return
+  table = '%s_%d' % (name, start)
+  ops = trace.ops[start:start + period * repeats]
+  out.write('  static const replay_op_t %s[] = {' % table)
+  for i, (_, index, size) in enumerate(ops):
+    out.write('%s{%d, %d},' % ('\n    ' if i % 6 == 0 else ' ', index, size))
+  out.write('\n  };\n')
+  out.write('  for (const replay_op_t *o = %s; o < %s + %d; o += %d) {\n' %
+            (table, table, len(ops), period))
+  for j in range(period):
+    kind = ops[j][0]
+    out.write('    %s\n' % statement(
+        kind, 'b[o[%d].index]' % j, 'o[%d].size' % j,
+        '%d + (o - %s) + %d' % (start, table, j)))
+  out.write('  }\n')
+
+
+def compile_trace(out, trace, chunk, max_period, min_ops):
+  name = c_name(trace.name)
+  # Split into functions of about chunk statements each
+  chunks = [[]]
+  weight = 0
+  for segment in segments(trace, max_period, min_ops):
+    if weight >= chunk:
+      chunks.append([])
+      weight = 0
+    chunks[-1].append(segment)
+    weight += segment[1]
+  out.write('/* %s */\n' % trace.name)
+  out.write('#undef trace_name\n#define trace_name "%s"\n\n' % trace.name)
+  for c, segs in enumerate(chunks):
+    out.write('static void %s_%d(void) {\n' % (name, c))
+    for start, period, repeats in segs:
+      compile_segment(out, trace, name, start, period, repeats)
+    out.write('}\n\n')
+  out.write('static void (*const %s_chunks[])(void) = {\n' % name)
+  for c in range(len(chunks)):
+    out.write('  %s_%d,\n' % (name, c))
+  out.write('};\n\n')
+  return '  {"%s", %d, %d, %s_chunks},\n' % (trace.name, trace.num_ops,
+                                             len(chunks), name)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description='Compile traces into C for the replay benchmark.')
+  parser.add_argument('traces', nargs='+',
+                      help='trace files or directories of traces')
+  parser.add_argument('--chunk', type=int, default=1000,
+                      help='statements per generated function')
+  parser.add_argument('--period', type=int, default=8,
+                      help='longest pattern of op kinds compiled as a loop')
+  parser.add_argument('--min-run', type=int, default=8,
+                      help='fewest ops compiled as a loop')
+  parser.add_argument('-o', '--output', default=None,
+                      help='output C file (default: stdout)')
+  args = parser.parse_args()
+
+  traces = [tr.read_trace(path, extended=True)
+            for path in tr.trace_files(args.traces)]
+  out = open(args.output, 'w') if args.output else sys.stdout
+  out.write(HEADER)
+  out.write('static char *b[%d];\n\n' %
+            max([t.num_ids for t in traces] + [1]))
+  entries = [compile_trace(out, t, args.chunk, args.period, args.min_run)
+             for t in traces]
+  out.write('const replay_trace_t CAT(REPLAY_IMPL, replay_traces)[] = {\n')
+  out.write(''.join(entries))
+  out.write('  {NULL, 0, 0, NULL},\n')
+  out.write('};\n')
+  if args.output:
+    out.close()
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,144 @@
+#!/usr/bin/env python
+#
+# tracefile.py - read and write mdriver trace files.
+#
+# A trace is a four line header (suggested heap size, number of ids, number
+# of ops, weight) followed by one op per line, exactly as parsed by
+# read_trace() in mdriver.c:
+#   a {id} {size}           allocate memory - malloc()
+#   f {id}                  deallocate memory - free()
+#   r {id} {size}           reallocate memory - realloc()
+#   w {id} {size}           write memory
+# and, in the extended grammar:
+#   c {id} {size}           calloc() of size bytes in all
+#   m {id} {align} {size}   aligned allocation - memalign() and friends
+#   F {id} {size}           sized free
+# Any op may end with annotations: t={thread id} s={call-site id}
+# ts={timestamp in ns}.
+#
+# Ops are kept as (type, id, size) tuples; free ops have size 0. By default
+# read_trace() maps the extended ops to a, a and f and drops annotations, so
+# tools that only know the classic ops work on any trace. With
+# extended=True, ops keep their type, and trace.info holds a dict per op
+# (None if it has nothing) with 'align' for m ops and 't', 's', 'ts' for
+# annotations; write_trace() writes them back.
+from __future__ import print_function, division
+
+import os
+
+ALLOC = 'a'
+FREE = 'f'
+REALLOC = 'r'
+WRITE = 'w'
+CALLOC = 'c'
+MEMALIGN = 'm'
+FREE_SIZED = 'F'
+
+ANNOTATIONS = ('t', 's', 'ts')
+
+# Must match ALIGNMENT and HEADER_SIZE in allocator.c.
+ALIGNMENT = 8
+HEADER_SIZE = 8
+
+# Must match MEM_ALLOWANCE in config.h.
+MEM_ALLOWANCE = 40 * (1 << 10)
+
+
+def align(size, alignment=ALIGNMENT):
+  return (size + alignment - 1) & ~(alignment - 1)
+
+
+class Trace(object):
+  def __init__(self, ops, sugg_heapsize=0, weight=1, name=None, info=None):
+    self.ops = ops
+    self.info = info
+    self.sugg_heapsize = sugg_heapsize
+    self.weight = weight
+    self.name = name
+
+  @property
+  def num_ids(self):
+    return max(op[1] for op in self.ops) + 1 if self.ops else 0
+
+  @property
+  def num_ops(self):
+    return len(self.ops)
+
+
+def read_trace(path, extended=False):
+  """Read the trace file at path (see the top of the file for extended)."""
+  with open(path) as f:
+    tokens = f.read().split()
+  sugg_heapsize, num_ids, num_ops, weight = [int(t) for t in tokens[:4]]
+  ops = []
+  info = []
+  i = 4
+  while i < len(tokens):
+    kind = tokens[i][0]
+    extra = {}
+    if kind == FREE:
+      ops.append((FREE, int(tokens[i + 1]), 0))
+      i += 2
+    elif kind in (ALLOC, REALLOC, WRITE, CALLOC, FREE_SIZED):
+      ops.append((kind, int(tokens[i + 1]), int(tokens[i + 2])))
+      i += 3
+    elif kind == MEMALIGN:
+      ops.append((kind, int(tokens[i + 1]), int(tokens[i + 3])))
+      extra['align'] = int(tokens[i + 2])
+      i += 4
+    else:
+      raise ValueError('Bogus type character (%s) in tracefile %s'
+                       % (kind, path))
+    while i < len(tokens) and '=' in tokens[i]:
+      key, value = tokens[i].split('=', 1)
+      if key not in ANNOTATIONS:
+        raise ValueError('Bogus annotation (%s) in tracefile %s'
+                         % (tokens[i], path))
+      extra[key] = int(value)
+      i += 1
+    info.append(extra or None)
+  if len(ops) != num_ops:
+    raise ValueError('%s: header says %d ops, found %d'
+                     % (path, num_ops, len(ops)))
+  if not extended:
+    plain = {CALLOC: ALLOC, MEMALIGN: ALLOC, FREE_SIZED: FREE}
+    ops = [(plain[kind], index, 0 if kind == FREE_SIZED else size)
+           if kind in plain else (kind, index, size)
+           for kind, index, size in ops]
+    info = None
+  elif not any(info):
+    info = None
+  return Trace(ops, sugg_heapsize, weight, os.path.basename(path), info)
+
+
+def write_trace(f, trace):
+  """Write trace to the open file f, with a header matching its ops."""
+  f.write('%d\n%d\n%d\n%d\n' % (trace.sugg_heapsize, trace.num_ids,
+                                trace.num_ops, trace.weight))
+  for i, (kind, index, size) in enumerate(trace.ops):
+    extra = trace.info[i] if trace.info else None
+    if kind == FREE:
+      line = 'f %d' % index
+    elif kind == MEMALIGN:
+      line = 'm %d %d %d' % (index, extra['align'], size)
+    else:
+      line = '%s %d %d' % (kind, index, size)
+    if extra:
+      for key in ANNOTATIONS:
+        if key in extra:
+          line += ' %s=%d' % (key, extra[key])
+    f.write(line + '\n')
+
+
+def trace_files(paths):
+  """Expand a list of trace files and directories into trace files, the way
+  mdriver -t does (every file not starting with '.')."""
+  files = []
+  for path in paths:
+    if os.path.isdir(path):
+      for name in sorted(os.listdir(path)):
+        if not name.startswith('.'):
+          files.append(os.path.join(path, name))
+    else:
+      files.append(path)
+  return files
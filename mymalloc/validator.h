@@ -43,26 +43,40 @@ typedef struct range_t {
 // range list to detect any overlapping allocated blocks.
 
 
-// add_range - As directed by request opnum in trace tracenum,
-// we've just called the student's malloc to allocate a block of
-// size bytes at addr lo. After checking the block for correctness,
-// we create a range struct for this block and add it to the range list.
-static int add_range(const malloc_impl_t* impl, range_t** ranges, char* lo,
-    int size, int tracenum, int opnum) {
-  assert(size > 0);
-
+// check_range - Check that a block of size bytes at addr lo is
+// R_ALIGNMENT-byte aligned and lies within the extent of the heap. These
+// checks are cheap, so they are applied to every block even when the
+// validator is sampling.
+static int check_range(char* lo, int size, int tracenum, int opnum) {
   char* hi = lo + size - 1;
 
   // Payload addresses must be R_ALIGNMENT-byte aligned
   if (!IS_ALIGNED(lo)) {
     printf("Payload address (lo=%p) is not %d-byte aligned.\n", lo, R_ALIGNMENT);
-    malloc_error(tracenum, 0, "payload misalignment");
+    malloc_error(tracenum, opnum, "payload misalignment");
     return 0;
   }
 
   // The payload must lie within the extent of the heap
   if (lo < (char*)mem_heap_lo() || hi > (char*)mem_heap_hi()) {
-    malloc_error(tracenum, 0, "payload not in heap");
+    malloc_error(tracenum, opnum, "payload not in heap");
+    return 0;
+  }
+
+  return 1;
+}
+
+// add_range - As directed by request opnum in trace tracenum,
+// we've just called the student's malloc to allocate a block of
+// size bytes at addr lo. After checking the block for correctness,
+// we create a range struct for this block and add it to the range list.
+static int add_range(const malloc_impl_t* impl, range_t** ranges, char* lo,
+    int size, int tracenum, int opnum) {
+  assert(size > 0);
+
+  char* hi = lo + size - 1;
+
+  if (!check_range(lo, size, tracenum, opnum)) {
     return 0;
   }
 
@@ -73,7 +87,7 @@ static int add_range(const malloc_impl_t* impl, range_t** ranges, char* lo,
         (p->lo <= lo && p->hi >= lo)) {
       printf("Payload (%p - %p) overlaps existing payload (%p - %p).\n",
              lo, hi, p->lo, p->hi);
-      malloc_error(tracenum, 0, "payload overlap");
+      malloc_error(tracenum, opnum, "payload overlap");
       return 0;
     }
     p = p->next;
@@ -131,15 +145,57 @@ static void clear_ranges(range_t **ranges) {
   *ranges = NULL;
 }
 
-// eval_mm_valid - Check the malloc package for correctness
-int eval_mm_valid(const malloc_impl_t *impl, trace_t *trace, int tracenum) {
+// Sampling
+
+// id_sampled - Returns true if block id index is one of the ids that are
+// fully validated at the given sample rate. The choice is made by a
+// multiplicative hash of the id, so it is stable from run to run.
+static int id_sampled(int index, double rate) {
+  if (rate >= 1.0) {
+    return 1;
+  }
+  uint32_t h = (uint32_t)index * 2654435761U;
+  return h < (uint32_t)(rate * 4294967295.0);
+}
+
+// window_rand - xorshift32 step, used to place the full-validation windows.
+static uint32_t window_rand(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+// fill_block - Fill a block with data that can be checked after a realloc.
+static void fill_block(char* p, int from, int size) {
+  for (int j = from; j < size; j++) {
+    p[j] = (uint8_t)j;
+  }
+}
+
+// eval_mm_valid_sampled - Check the malloc package for correctness, fully
+// validating only a fraction of the work.
+//
+// Block ids selected by id_sampled() are tracked in the range list and get
+// the overlap and data checks. Every other block only has its alignment and
+// heap bounds checked. On top of that, windows of VALID_WINDOW_OPS ops are
+// started at random (probability VALID_WINDOW_PROB per op); inside a window
+// every allocated or reallocated block is tracked as if it were sampled.
+// With rate >= 1.0 this is the full validator.
+int eval_mm_valid_sampled(const malloc_impl_t *impl, trace_t *trace,
+                          int tracenum, double rate) {
   int i = 0;
   int index = 0;
   int size = 0;
   int oldsize = 0;
+  int window = 0;  // ops left in the current full-validation window
+  uint32_t seed = 0x9E3779B9U ^ (uint32_t)tracenum;
   char *newp = NULL;
   char *oldp = NULL;
   char *p = NULL;
+  char *tracked = NULL;  // is block id in the range list?
   range_t *ranges = NULL;
 
   // Reset the heap.
@@ -151,30 +207,66 @@ int eval_mm_valid(const malloc_impl_t *impl, trace_t *trace, int tracenum) {
     return 0;
   }
 
+  if ((tracked = (char *) calloc(trace->num_ids, sizeof(char))) == NULL) {
+    unix_error("calloc failed in eval_mm_valid");
+  }
+
   // Interpret each operation in the trace in order
   for (i = 0; i < trace->num_ops; i++) {
     index = trace->ops[i].index;
     size = trace->ops[i].size;
 
+    if (window > 0) {
+      window--;
+    } else if (rate < 1.0 &&
+               window_rand(&seed) < (uint32_t)(VALID_WINDOW_PROB * 4294967295.0)) {
+      window = VALID_WINDOW_OPS;
+    }
+    int full = window > 0 || id_sampled(index, rate);
+
     switch (trace->ops[i].type) {
       case ALLOC:  // malloc
+      case CALLOC:  // calloc
+      case MEMALIGN:  // aligned alloc
 
-        // Call the student's malloc
-        if ((p = (char *) impl->malloc(size)) == NULL) {
+        // Call the student's malloc (or calloc, or memalign)
+        if ((p = (char *) trace_alloc(impl, &trace->ops[i])) == NULL) {
           malloc_error(tracenum, i, "impl malloc failed.");
-          return 0;
+          goto fail;
         }
 
-        // Test the range of the new block for correctness and add it
-        // to the range list if OK. The block must be  be aligned properly,
-        // and must not overlap any currently allocated block.
-        if (add_range(impl, &ranges, p, size, tracenum, i) == 0)
-          return 0;
+        // An aligned block must have the requested alignment
+        if (trace->ops[i].type == MEMALIGN &&
+            ((uintptr_t)p & (trace->ops[i].align - 1))) {
+          printf("Payload address (lo=%p) is not %d-byte aligned.\n", p,
+                 trace->ops[i].align);
+          malloc_error(tracenum, i, "memalign misalignment");
+          goto fail;
+        }
+
+        // A calloc'd block must come back zeroed
+        if (full && trace->ops[i].type == CALLOC) {
+          for (int j = 0; j < size; j++) {
+            if (p[j]) {
+              malloc_error(tracenum, i, "calloc block not zeroed");
+              goto fail;
+            }
+          }
+        }
 
-        // Fill the allocated region with some unique data that you can check
-        // for if the region is copied via realloc.
-        for (int j = 0; j < size; j++) {
-          p[j] = (uint8_t)j;
+        if (full) {
+          // Test the range of the new block for correctness and add it
+          // to the range list if OK. The block must be  be aligned properly,
+          // and must not overlap any currently allocated block.
+          if (add_range(impl, &ranges, p, size, tracenum, i) == 0)
+            goto fail;
+
+          // Fill the allocated region with some unique data that you can
+          // check for if the region is copied via realloc.
+          fill_block(p, 0, size);
+          tracked[index] = 1;
+        } else if (check_range(p, size, tracenum, i) == 0) {
+          goto fail;
         }
 
         // Remember region
@@ -188,30 +280,38 @@ int eval_mm_valid(const malloc_impl_t *impl, trace_t *trace, int tracenum) {
         oldp = trace->blocks[index];
         if ((newp = (char *) impl->realloc(oldp, size)) == NULL) {
           malloc_error(tracenum, i, "impl realloc failed.");
-          return 0;
+          goto fail;
         }
 
-        // Remove the old region from the range list
-        remove_range(&ranges, oldp);
+        if (tracked[index]) {
+          // Remove the old region from the range list
+          remove_range(&ranges, oldp);
 
-        // Check new block for correctness and add it to range list
-        if (add_range(impl, &ranges, newp, size, tracenum, i) == 0)
-          return 0;
+          // Check new block for correctness and add it to range list
+          if (add_range(impl, &ranges, newp, size, tracenum, i) == 0)
+            goto fail;
 
-        // Make sure that the new block contains the data from the old block,
-        // and then fill in the new block with new data that you can use to
-        // verify the block was copied if it is resized again.
-        oldsize = trace->block_sizes[index];
-        if (size < oldsize) oldsize = size;
-        for (int j = 0; j < size; j++) {
-          if (j < oldsize) {
+          // Make sure that the new block contains the data from the old
+          // block, and then fill in the new block with new data that you
+          // can use to verify the block was copied if it is resized again.
+          oldsize = trace->block_sizes[index];
+          if (size < oldsize) oldsize = size;
+          for (int j = 0; j < oldsize; j++) {
             if ((uint8_t)newp[j] != (uint8_t)j) {
               malloc_error(tracenum, i, "realloc incorrect");
-              return 0;
+              goto fail;
             }
-          } else {
-            newp[j] = (uint8_t)j;
           }
+          fill_block(newp, oldsize, size);
+        } else if (full) {
+          // Start tracking the block. Its old contents were never filled,
+          // so there is nothing to compare against yet.
+          if (add_range(impl, &ranges, newp, size, tracenum, i) == 0)
+            goto fail;
+          fill_block(newp, 0, size);
+          tracked[index] = 1;
+        } else if (check_range(newp, size, tracenum, i) == 0) {
+          goto fail;
         }
 
         // Remember region
@@ -220,11 +320,15 @@ int eval_mm_valid(const malloc_impl_t *impl, trace_t *trace, int tracenum) {
         break;
 
       case FREE:  // free
+      case FREE_SIZED:  // sized free
 
         // Remove region from list and call student's free function
         p = trace->blocks[index];
-        remove_range(&ranges, p);
-        impl->free(p);
+        if (tracked[index]) {
+          remove_range(&ranges, p);
+          tracked[index] = 0;
+        }
+        trace_free(impl, &trace->ops[i], p);
         break;
 
       case WRITE:  // write
@@ -239,8 +343,19 @@ int eval_mm_valid(const malloc_impl_t *impl, trace_t *trace, int tracenum) {
   // Free ranges allocated and reset the heap.
   impl->reset_brk();
   clear_ranges(&ranges);
+  free(tracked);
 
   // As far as we know, this is a valid malloc package
   return 1;
+
+fail:
+  clear_ranges(&ranges);
+  free(tracked);
+  return 0;
+}
+
+// eval_mm_valid - Check the malloc package for correctness
+int eval_mm_valid(const malloc_impl_t *impl, trace_t *trace, int tracenum) {
+  return eval_mm_valid_sampled(impl, trace, tracenum, 1.0);
 }
 #endif  // MM_VALIDATOR_H
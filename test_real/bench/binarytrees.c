@@ -0,0 +1,67 @@
+/*
+ * binarytrees - The binary-trees benchmark: many short-lived trees of
+ * small, equal-sized nodes next to one long-lived tree.
+ *
+ *   BINARYtrees [max_depth]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct node_t {
+  struct node_t* left;
+  struct node_t* right;
+} node_t;
+
+static node_t* make(int depth) {
+  node_t* node = malloc(sizeof(node_t));
+  if (depth > 0) {
+    node->left = make(depth - 1);
+    node->right = make(depth - 1);
+  } else {
+    node->left = node->right = NULL;
+  }
+  return node;
+}
+
+static long check(node_t* node) {
+  if (!node->left) return 1;
+  return 1 + check(node->left) + check(node->right);
+}
+
+static void destroy(node_t* node) {
+  if (node->left) {
+    destroy(node->left);
+    destroy(node->right);
+  }
+  free(node);
+}
+
+int main(int argc, char** argv) {
+  int max_depth = argc > 1 ? atoi(argv[1]) : 16;
+  int min_depth = 4;
+  if (max_depth < min_depth + 2) max_depth = min_depth + 2;
+
+  node_t* stretch = make(max_depth + 1);
+  printf("stretch tree of depth %d\t check: %ld\n", max_depth + 1,
+         check(stretch));
+  destroy(stretch);
+
+  node_t* long_lived = make(max_depth);
+
+  for (int depth = min_depth; depth <= max_depth; depth += 2) {
+    long iterations = 1L << (max_depth - depth + min_depth);
+    long total = 0;
+    for (long i = 0; i < iterations; i++) {
+      node_t* tree = make(depth);
+      total += check(tree);
+      destroy(tree);
+    }
+    printf("%ld\t trees of depth %d\t check: %ld\n", iterations, depth, total);
+  }
+
+  printf("long lived tree of depth %d\t check: %ld\n", max_depth,
+         check(long_lived));
+  destroy(long_lived);
+  return 0;
+}
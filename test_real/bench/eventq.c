@@ -0,0 +1,111 @@
+/*
+ * eventq - A discrete event simulation: a binary heap of pending events
+ * ordered by time. Each event carries a payload of varying size, and when
+ * handled schedules zero to two follow-up events, so the queue breathes
+ * around a steady size and events die in time order, not allocation order.
+ *
+ *   EVENTq [num_events]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  double time;
+  uint32_t kind;
+  uint32_t length;
+  char payload[];
+} event_t;
+
+typedef struct {
+  event_t** events;
+  size_t count;
+  size_t capacity;
+} queue_t;
+
+static uint64_t seed = 1;
+
+static uint32_t next_rand() {
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return seed >> 33;
+}
+
+static void push(queue_t* q, event_t* event) {
+  if (q->count == q->capacity) {
+    q->capacity = q->capacity ? q->capacity * 2 : 64;
+    q->events = realloc(q->events, q->capacity * sizeof(event_t*));
+  }
+  size_t i = q->count++;
+  while (i > 0 && q->events[(i - 1) / 2]->time > event->time) {
+    q->events[i] = q->events[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  q->events[i] = event;
+}
+
+static event_t* pop(queue_t* q) {
+  event_t* top = q->events[0];
+  event_t* last = q->events[--q->count];
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= q->count) break;
+    if (child + 1 < q->count &&
+        q->events[child + 1]->time < q->events[child]->time) {
+      child++;
+    }
+    if (last->time <= q->events[child]->time) break;
+    q->events[i] = q->events[child];
+    i = child;
+  }
+  q->events[i] = last;
+  return top;
+}
+
+static event_t* make_event(double now, uint32_t kind) {
+  uint32_t r = next_rand();
+  // Sizes by kind: small timers, medium messages, rare large transfers
+  uint32_t length = kind == 0 ? 8 : kind == 1 ? 32 + r % 224 : 1024 + r % 8192;
+  event_t* event = malloc(sizeof(event_t) + length);
+  event->time = now + (r % 1000 + 1) / 100.0;
+  event->kind = kind;
+  event->length = length;
+  memset(event->payload, kind, length);
+  return event;
+}
+
+static uint32_t random_kind() {
+  uint32_t r = next_rand() % 100;
+  return r < 60 ? 0 : r < 98 ? 1 : 2;
+}
+
+int main(int argc, char** argv) {
+  long num_events = argc > 1 ? atol(argv[1]) : 3000000;
+  queue_t q = {NULL, 0, 0};
+
+  for (int i = 0; i < 10000; i++) push(&q, make_event(0, random_kind()));
+
+  uint64_t checksum = 0;
+  size_t max_queue = 0;
+  for (long handled = 0; handled < num_events && q.count; handled++) {
+    event_t* event = pop(&q);
+    checksum += event->kind + (uint8_t)event->payload[event->length - 1];
+
+    // Keep the queue near its initial size on average
+    uint32_t r = next_rand() % 100;
+    int spawn = r < 25 ? 0 : r < 75 ? 1 : 2;
+    for (int i = 0; i < spawn; i++) {
+      push(&q, make_event(event->time, random_kind()));
+    }
+    free(event);
+    if (q.count > max_queue) max_queue = q.count;
+  }
+
+  printf("left %zu max %zu checksum %llu\n", q.count, max_queue,
+         (unsigned long long)checksum);
+  while (q.count) free(pop(&q));
+  free(q.events);
+  return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * hashtable - A chained hash table from string keys to values, doubling its
+ * bucket array as it fills, under a mix of inserts, lookups and deletes.
+ * Keys and entries are separate allocations of varying size.
+ *
+ *   HASHtable [num_ops]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct entry_t {
+  struct entry_t* next;
+  char* key;
+  long value;
+} entry_t;
+
+typedef struct {
+  entry_t** buckets;
+  size_t num_buckets;
+  size_t count;
+} table_t;
+
+static uint64_t hash(const char* key) {
+  uint64_t h = 14695981039346656037ULL;
+  for (; *key; key++) h = (h ^ (uint8_t)*key) * 1099511628211ULL;
+  return h;
+}
+
+static void rehash(table_t* table) {
+  size_t num_buckets = table->num_buckets * 2;
+  entry_t** buckets = calloc(num_buckets, sizeof(entry_t*));
+  for (size_t i = 0; i < table->num_buckets; i++) {
+    entry_t* entry = table->buckets[i];
+    while (entry) {
+      entry_t* next = entry->next;
+      size_t b = hash(entry->key) & (num_buckets - 1);
+      entry->next = buckets[b];
+      buckets[b] = entry;
+      entry = next;
+    }
+  }
+  free(table->buckets);
+  table->buckets = buckets;
+  table->num_buckets = num_buckets;
+}
+
+static entry_t** find(table_t* table, const char* key) {
+  entry_t** entry = &table->buckets[hash(key) & (table->num_buckets - 1)];
+  while (*entry && strcmp((*entry)->key, key)) entry = &(*entry)->next;
+  return entry;
+}
+
+static void insert(table_t* table, const char* key, long value) {
+  entry_t** slot = find(table, key);
+  if (*slot) {
+    (*slot)->value = value;
+    return;
+  }
+  entry_t* entry = malloc(sizeof(entry_t));
+  size_t len = strlen(key);
+  entry->key = malloc(len + 1);
+  memcpy(entry->key, key, len + 1);
+  entry->value = value;
+  entry->next = NULL;
+  *slot = entry;
+  if (++table->count > table->num_buckets) rehash(table);
+}
+
+static int erase(table_t* table, const char* key) {
+  entry_t** slot = find(table, key);
+  entry_t* entry = *slot;
+  if (!entry) return 0;
+  *slot = entry->next;
+  free(entry->key);
+  free(entry);
+  table->count--;
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  long num_ops = argc > 1 ? atol(argv[1]) : 2000000;
+  uint32_t key_range = num_ops / 4 + 1;
+  table_t table = {calloc(16, sizeof(entry_t*)), 16, 0};
+
+  char key[64];
+  long found = 0, erased = 0;
+  uint64_t seed = 1;
+  for (long i = 0; i < num_ops; i++) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t r = seed >> 33;
+    // Keys from a range a bit larger than the live set, with long tails
+    int pad = r % 7 == 0 ? (int)(r % 40) : 0;
+    snprintf(key, sizeof(key), "key-%u-%.*s", (r >> 3) % key_range, pad,
+             "........................................");
+    switch (r % 4) {
+      case 0:
+      case 1:
+        insert(&table, key, i);
+        break;
+      case 2:
+        found += *find(&table, key) != NULL;
+        break;
+      default:
+        erased += erase(&table, key);
+    }
+  }
+  printf("size %zu buckets %zu found %ld erased %ld\n", table.count,
+         table.num_buckets, found, erased);
+
+  for (size_t i = 0; i < table.num_buckets; i++) {
+    entry_t* entry = table.buckets[i];
+    while (entry) {
+      entry_t* next = entry->next;
+      free(entry->key);
+      free(entry);
+      entry = next;
+    }
+  }
+  free(table.buckets);
+  return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * json - Builds JSON documents in a growing string buffer, then tokenizes
+ * them into a growing array of tokens, each holding a copy of its text.
+ * Mostly realloc growth and many small, short-lived strings.
+ *
+ *   JSONtok [num_docs]
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// String builder
+
+typedef struct {
+  char* data;
+  size_t length;
+  size_t capacity;
+} sb_t;
+
+static void sb_append(sb_t* sb, const char* str, size_t length) {
+  if (sb->length + length + 1 > sb->capacity) {
+    while (sb->length + length + 1 > sb->capacity) {
+      sb->capacity = sb->capacity ? sb->capacity * 2 : 16;
+    }
+    sb->data = realloc(sb->data, sb->capacity);
+  }
+  memcpy(sb->data + sb->length, str, length);
+  sb->length += length;
+  sb->data[sb->length] = '\0';
+}
+
+static void sb_puts(sb_t* sb, const char* str) {
+  sb_append(sb, str, strlen(str));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Documents
+
+static uint64_t seed = 1;
+
+static uint32_t next_rand() {
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return seed >> 33;
+}
+
+static void gen_value(sb_t* sb, int depth) {
+  char buf[64];
+  uint32_t r = next_rand();
+  switch (depth > 3 ? r % 3 : r % 5) {
+    case 0:
+      snprintf(buf, sizeof(buf), "%d", (int)(r % 100000) - 50000);
+      sb_puts(sb, buf);
+      break;
+    case 1:
+      sb_puts(sb, r & 8 ? "true" : "null");
+      break;
+    case 2: {
+      int length = r % 24 + 1;
+      sb_puts(sb, "\"");
+      for (int i = 0; i < length; i++) {
+        buf[i] = 'a' + next_rand() % 26;
+      }
+      sb_append(sb, buf, length);
+      sb_puts(sb, "\"");
+      break;
+    }
+    case 3: {
+      int n = r % 8;
+      sb_puts(sb, "[");
+      for (int i = 0; i < n; i++) {
+        if (i) sb_puts(sb, ",");
+        gen_value(sb, depth + 1);
+      }
+      sb_puts(sb, "]");
+      break;
+    }
+    default: {
+      int n = r % 6;
+      sb_puts(sb, "{");
+      for (int i = 0; i < n; i++) {
+        if (i) sb_puts(sb, ",");
+        snprintf(buf, sizeof(buf), "\"field%u\":", next_rand() % 50);
+        sb_puts(sb, buf);
+        gen_value(sb, depth + 1);
+      }
+      sb_puts(sb, "}");
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tokenizer
+
+typedef struct {
+  char type;   // one of {}[],: or s (string), n (number), l (literal)
+  char* text;  // copy of the token's text for s, n and l, else NULL
+} token_t;
+
+typedef struct {
+  token_t* tokens;
+  size_t count;
+  size_t capacity;
+} tokens_t;
+
+static void push(tokens_t* tokens, char type, const char* text, size_t length) {
+  if (tokens->count == tokens->capacity) {
+    tokens->capacity = tokens->capacity ? tokens->capacity * 3 / 2 : 8;
+    tokens->tokens = realloc(tokens->tokens,
+                             tokens->capacity * sizeof(token_t));
+  }
+  token_t* token = &tokens->tokens[tokens->count++];
+  token->type = type;
+  token->text = NULL;
+  if (text) {
+    token->text = malloc(length + 1);
+    memcpy(token->text, text, length);
+    token->text[length] = '\0';
+  }
+}
+
+static void tokenize(const char* str, tokens_t* tokens) {
+  while (*str) {
+    const char* start = str;
+    if (strchr("{}[],:", *str)) {
+      push(tokens, *str++, NULL, 0);
+    } else if (*str == '"') {
+      str++;
+      while (*str != '"') str++;
+      push(tokens, 's', start + 1, str - start - 1);
+      str++;
+    } else if (*str == '-' || isdigit(*str)) {
+      str++;
+      while (isdigit(*str)) str++;
+      push(tokens, 'n', start, str - start);
+    } else {
+      while (isalpha(*str)) str++;
+      push(tokens, 'l', start, str - start);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  int num_docs = argc > 1 ? atoi(argv[1]) : 2000;
+
+  uint64_t checksum = 0;
+  size_t total_tokens = 0;
+  for (int d = 0; d < num_docs; d++) {
+    sb_t sb = {NULL, 0, 0};
+    int records = next_rand() % 200 + 1;
+    sb_puts(&sb, "[");
+    for (int i = 0; i < records; i++) {
+      if (i) sb_puts(&sb, ",");
+      gen_value(&sb, 0);
+    }
+    sb_puts(&sb, "]");
+
+    tokens_t tokens = {NULL, 0, 0};
+    tokenize(sb.data, &tokens);
+    free(sb.data);
+
+    for (size_t i = 0; i < tokens.count; i++) {
+      checksum = checksum * 31 + tokens.tokens[i].type;
+      if (tokens.tokens[i].text) {
+        checksum += strlen(tokens.tokens[i].text);
+        free(tokens.tokens[i].text);
+      }
+    }
+    total_tokens += tokens.count;
+    free(tokens.tokens);
+  }
+  printf("tokens %zu checksum %llu\n", total_tokens,
+         (unsigned long long)checksum);
+  return 0;
+}
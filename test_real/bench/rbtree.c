@@ -0,0 +1,186 @@
+/*
+ * rbtree - A red-black tree map (left-leaning) from integer keys to values of
+ * varying size, under random inserts, value updates (realloc) and deletes.
+ *
+ *   RBtree [num_ops]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RED 1
+#define BLACK 0
+
+typedef struct node_t {
+  struct node_t* left;
+  struct node_t* right;
+  uint32_t key;
+  uint32_t length;
+  char color;
+  char* value;
+} node_t;
+
+static int is_red(node_t* node) {
+  return node && node->color == RED;
+}
+
+static node_t* rotate_left(node_t* h) {
+  node_t* x = h->right;
+  h->right = x->left;
+  x->left = h;
+  x->color = h->color;
+  h->color = RED;
+  return x;
+}
+
+static node_t* rotate_right(node_t* h) {
+  node_t* x = h->left;
+  h->left = x->right;
+  x->right = h;
+  x->color = h->color;
+  h->color = RED;
+  return x;
+}
+
+static void flip(node_t* h) {
+  h->color = !h->color;
+  h->left->color = !h->left->color;
+  h->right->color = !h->right->color;
+}
+
+static node_t* fix_up(node_t* h) {
+  if (is_red(h->right) && !is_red(h->left)) h = rotate_left(h);
+  if (is_red(h->left) && is_red(h->left->left)) h = rotate_right(h);
+  if (is_red(h->left) && is_red(h->right)) flip(h);
+  return h;
+}
+
+static void set_value(node_t* node, uint32_t length) {
+  node->value = realloc(node->value, length);
+  memset(node->value, node->key & 0xff, length);
+  node->length = length;
+}
+
+static node_t* insert(node_t* h, uint32_t key, uint32_t length) {
+  if (!h) {
+    node_t* node = malloc(sizeof(node_t));
+    node->left = node->right = NULL;
+    node->key = key;
+    node->color = RED;
+    node->value = NULL;
+    set_value(node, length);
+    return node;
+  }
+  if (key < h->key) {
+    h->left = insert(h->left, key, length);
+  } else if (key > h->key) {
+    h->right = insert(h->right, key, length);
+  } else {
+    set_value(h, length);
+  }
+  return fix_up(h);
+}
+
+static node_t* move_red_left(node_t* h) {
+  flip(h);
+  if (is_red(h->right->left)) {
+    h->right = rotate_right(h->right);
+    h = rotate_left(h);
+    flip(h);
+  }
+  return h;
+}
+
+static node_t* move_red_right(node_t* h) {
+  flip(h);
+  if (is_red(h->left->left)) {
+    h = rotate_right(h);
+    flip(h);
+  }
+  return h;
+}
+
+static node_t* delete_min(node_t* h, node_t** min) {
+  if (!h->left) {
+    *min = h;
+    return NULL;
+  }
+  if (!is_red(h->left) && !is_red(h->left->left)) h = move_red_left(h);
+  h->left = delete_min(h->left, min);
+  return fix_up(h);
+}
+
+static node_t* erase(node_t* h, uint32_t key) {
+  if (key < h->key) {
+    if (!h->left) return h;
+    if (!is_red(h->left) && !is_red(h->left->left)) h = move_red_left(h);
+    h->left = erase(h->left, key);
+  } else {
+    if (is_red(h->left)) h = rotate_right(h);
+    if (key == h->key && !h->right) {
+      free(h->value);
+      free(h);
+      return NULL;
+    }
+    if (!h->right) return h;
+    if (!is_red(h->right) && !is_red(h->right->left)) h = move_red_right(h);
+    if (key == h->key) {
+      // Replace h by its successor
+      node_t* min;
+      node_t* right = delete_min(h->right, &min);
+      min->left = h->left;
+      min->right = right;
+      min->color = h->color;
+      free(h->value);
+      free(h);
+      h = min;
+    } else {
+      h->right = erase(h->right, key);
+    }
+  }
+  return fix_up(h);
+}
+
+static uint64_t sum(node_t* h, long* count) {
+  if (!h) return 0;
+  (*count)++;
+  return h->key + h->length + (uint8_t)h->value[0] + sum(h->left, count) +
+         sum(h->right, count);
+}
+
+static void destroy(node_t* h) {
+  if (!h) return;
+  destroy(h->left);
+  destroy(h->right);
+  free(h->value);
+  free(h);
+}
+
+int main(int argc, char** argv) {
+  long num_ops = argc > 1 ? atol(argv[1]) : 1000000;
+  uint32_t key_range = num_ops / 4 + 1;
+
+  node_t* root = NULL;
+  uint64_t seed = 1;
+  for (long i = 0; i < num_ops; i++) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t r = seed >> 33;
+    uint32_t key = (r >> 4) % key_range;
+    if (r % 3) {
+      // Mostly small values, with a few larger ones
+      uint32_t length = r % 10 ? 16 + (r >> 8) % 48 : 64 + (r >> 8) % 1024;
+      root = insert(root, key, length);
+    } else if (root) {
+      root = erase(root, key);
+    }
+    if (root) root->color = BLACK;
+  }
+
+  long count = 0;
+  uint64_t checksum = sum(root, &count);
+  printf("size %ld checksum %llu\n", count, (unsigned long long)checksum);
+  destroy(root);
+  return 0;
+}
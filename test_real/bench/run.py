@@ -0,0 +1,124 @@
+#!/usr/bin/env python
+#
+# run.py - run the bench programs against each allocator.
+#
+# For every alloc_type, builds the suite with scons (the build directory is
+# shared between allocators, so each is run right after it is built), runs
+# each program --runs times, and reports the best wall time, the peak RSS
+# and, for myimpl/badimpl, the peak heap size reported by malloc_wrap.c.
+# Times are also given relative to libcimpl when it was run.
+#
+# badimpl is the validator's deliberately broken allocator (fixed 4101-byte
+# blocks, no copy on realloc, no reuse), so it is not run by default and most
+# programs crash or run out of memory under it; failures are reported.
+#
+# Usage (from test_real/):
+#   bench/run.py
+#   bench/run.py --alloc myimpl --alloc libcimpl --runs 5 --mode release
+#   bench/run.py --no-build --alloc myimpl    # whatever is built already
+from __future__ import print_function, division
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+# Binary name, arguments
+PROGRAMS = [
+    ('BINARYtrees', []),
+    ('HASHtable', []),
+    ('JSONtok', []),
+    ('RBtree', []),
+    ('EVENTq', []),
+]
+
+ALLOC_TYPES = ['libcimpl', 'myimpl', 'badimpl']
+DEFAULT_ALLOC_TYPES = ['libcimpl', 'myimpl']
+
+
+def build(alloc_type, mode):
+  subprocess.check_call(['scons', '-Q', 'alloc_type=' + alloc_type,
+                         'mode=' + mode, 'bench'])
+
+
+def run_once(path, args):
+  """Runs a program, returns (seconds, peak RSS in KB, heap bytes or None),
+  or None if it failed (badimpl never reuses memory, and can run out)."""
+  env = dict(os.environ, MALLOC_WRAP_STATS='1')
+  with open(os.devnull, 'w') as devnull, tempfile.TemporaryFile() as err:
+    start = time.time()
+    proc = subprocess.Popen([path] + args, env=env, stdout=devnull,
+                            stderr=err)
+    # wait4 gives the child's own rusage, unlike RUSAGE_CHILDREN
+    _, status, usage = os.wait4(proc.pid, 0)
+    elapsed = time.time() - start
+    # The return code Popen would give: the exit status, or minus the signal
+    if os.WIFSIGNALED(status):
+      proc.returncode = -os.WTERMSIG(status)
+    else:
+      proc.returncode = os.WEXITSTATUS(status)
+    err.seek(0)
+    err = err.read().decode('utf-8', 'replace')
+  if proc.returncode < 0:
+    sys.stderr.write(err)
+    sys.stderr.write('%s killed by signal %d\n' % (path, -proc.returncode))
+    return None
+  if proc.returncode != 0:
+    sys.stderr.write(err)
+    sys.stderr.write('%s failed with status %d\n' % (path, proc.returncode))
+    return None
+
+  heap = None
+  for line in err.splitlines():
+    if line.startswith('heap: '):
+      heap = int(line.split()[1])
+  return elapsed, usage.ru_maxrss, heap
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description='Run the bench programs against each allocator.')
+  parser.add_argument('--alloc', action='append', choices=ALLOC_TYPES,
+                      help='allocator to run (repeatable; default %s)' %
+                      ' and '.join(DEFAULT_ALLOC_TYPES))
+  parser.add_argument('--runs', type=int, default=3,
+                      help='runs per program; the best time is reported')
+  parser.add_argument('--mode', default='release')
+  parser.add_argument('--no-build', action='store_true',
+                      help='run the binaries that are already built')
+  args = parser.parse_args()
+
+  alloc_types = args.alloc or DEFAULT_ALLOC_TYPES
+  bindir = os.path.join('build', args.mode, 'bench')
+  results = {}
+  for alloc_type in alloc_types:
+    if not args.no_build:
+      build(alloc_type, args.mode)
+    for name, prog_args in PROGRAMS:
+      runs = []
+      for _ in range(args.runs):
+        runs.append(run_once(os.path.join(bindir, name), prog_args))
+        if not runs[-1]: break
+      if runs[-1]:
+        results[(name, alloc_type)] = (min(r[0] for r in runs),
+                                       max(r[1] for r in runs), runs[0][2])
+
+  print('%-12s %-9s %9s %8s %11s %11s' %
+        ('program', 'alloc', 'time (s)', 'vs libc', 'rss (KB)', 'heap (KB)'))
+  for name, _ in PROGRAMS:
+    base = results.get((name, 'libcimpl'))
+    for alloc_type in alloc_types:
+      if (name, alloc_type) not in results:
+        print('%-12s %-9s %9s' % (name, alloc_type, 'failed'))
+        continue
+      secs, rss, heap = results[(name, alloc_type)]
+      print('%-12s %-9s %9.3f %8s %11d %11s' %
+            (name, alloc_type, secs,
+             '%.2fx' % (secs / base[0]) if base else '-', rss,
+             heap // 1024 if heap is not None else '-'))
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Frees a long run of neighbouring blocks, which coalesce into free blocks
+ * bigger than the largest bin (256 MB): they must go to the last bin and be
+ * reusable. Then allocates from them again. */
+
+#define NUM_BLOCKS 3000
+
+int main(){
+  char **array;
+  int i, round;
+
+  array = (char**)malloc(sizeof(char*)*NUM_BLOCKS);
+
+  for(round=0; round<2; round++){
+    for(i=0; i<NUM_BLOCKS; i++){
+      array[i] = (char*)malloc((size_t)i*100+1);
+      if(!array[i]){
+        printf("coalescetest: malloc failed\n");
+        return 1;
+      }
+      array[i][0] = (char)i;
+      array[i][(size_t)i*100] = (char)i;
+    }
+    for(i=0; i<NUM_BLOCKS; i++){
+      if(array[i][0] != (char)i || array[i][(size_t)i*100] != (char)i){
+        printf("coalescetest: block %d corrupted\n", i);
+        return 1;
+      }
+      free(array[i]);
+    }
+  }
+
+  free(array);
+  printf("coalescetest ok\n");
+  return 0;
+}
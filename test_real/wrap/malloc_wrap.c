@@ -0,0 +1,144 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+/*
+ * malloc_wrap.c - Link-time replacement of malloc/calloc/realloc/free.
+ *
+ * Programs are linked with -Wl,--wrap=malloc,--wrap=calloc,... (see
+ * wrap/SConscript), which sends every call the program makes to the
+ * __wrap_* functions below, and lets us reach libc through __real_*.
+ * They forward to the allocator picked by alloc_type, so programs need no
+ * changes at all. The heap is set up on the first call.
+ *
+ * Only the program's own objects are wrapped. Memory that libc allocates
+ * internally (strdup, getline, fopen, ...) comes from libc malloc and can
+ * still be handed to free(), so pointers outside our heap go back to libc.
+ * memlib is built with MEMLIB_SYSTEM, so it never calls malloc itself.
+ *
+ * With MALLOC_WRAP_STATS set in the environment, the heap size (its peak,
+ * as the heap never shrinks) is printed to stderr at exit; bench/run.py
+ * reads it.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "allocator_interface.h"
+#include "memlib.h"
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+#if defined(USE_MY_MALLOC)
+#define impl my_impl
+#elif defined(USE_BAD_MALLOC)
+#define impl bad_impl
+#endif
+
+#ifdef impl
+
+/* The allocators are not thread safe, so one lock covers every call */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int initialized = 0;
+
+static void print_stats() {
+  fprintf(stderr, "heap: %zu\n", initialized ? mem_heapsize() : 0);
+}
+
+/* Called with the lock held */
+static void ensure_init() {
+  if (!initialized) {
+    mem_init();
+    impl.init();
+    initialized = 1;
+    if (getenv("MALLOC_WRAP_STATS")) atexit(print_stats);
+  }
+}
+
+/* Whether ptr came from libc rather than from our heap */
+static int is_foreign(void* ptr) {
+  return !initialized || (uint8_t*)ptr < (uint8_t*)mem_heap_lo() ||
+         (uint8_t*)ptr > (uint8_t*)mem_heap_hi();
+}
+
+void* __wrap_malloc(size_t size) {
+  pthread_mutex_lock(&lock);
+  ensure_init();
+  void* ptr = impl.malloc(size);
+  pthread_mutex_unlock(&lock);
+  return ptr;
+}
+
+void __wrap_free(void* ptr) {
+  if (!ptr) return;
+  if (is_foreign(ptr)) {
+    __real_free(ptr);
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  impl.free(ptr);
+  pthread_mutex_unlock(&lock);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  size_t total = n * size;
+  if (size && total / size != n) return NULL;
+
+  void* ptr = __wrap_malloc(total);
+  if (ptr) memset(ptr, 0, total);
+  return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  if (ptr && is_foreign(ptr)) return __real_realloc(ptr, size);
+
+  pthread_mutex_lock(&lock);
+  ensure_init();
+  void* ptr_new = impl.realloc(ptr, size);
+  pthread_mutex_unlock(&lock);
+  return ptr_new;
+}
+
+#else  // libcimpl: straight through to libc
+
+void* __wrap_malloc(size_t size) {
+  return __real_malloc(size);
+}
+
+void __wrap_free(void* ptr) {
+  __real_free(ptr);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  return __real_realloc(ptr, size);
+}
+
+#endif  // impl
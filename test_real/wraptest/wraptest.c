@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* smalltest without any changes for the allocator: plain malloc/free, plus
+ * calloc, realloc, and a block allocated inside libc (strdup) */
+
+#define OUTER_LEN 100
+#define MAX_INNER_LEN 1000
+
+int main(){
+  int **array;
+  int i, j;
+
+  array = (int**)calloc(OUTER_LEN, sizeof(int*));
+
+  for(i=0; i<OUTER_LEN; i++){
+    int innerLen = rand()%MAX_INNER_LEN + 1;
+    array[i] = (int*)malloc(sizeof(int)*innerLen);
+    for(j=0; j<innerLen; j++){
+      array[i][j] = rand();
+    }
+    array[i] = (int*)realloc(array[i], sizeof(int)*innerLen*2);
+  }
+
+  char *name = strdup("wraptest");
+  printf("%s ok\n", name);
+  free(name);
+
+  for(i=0; i<OUTER_LEN; i++){
+    free(array[i]);
+  }
+  free(array);
+  return 0;
+}